@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Dynamic/Analysis/AliasPair.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace dynamic {
+
+// Set of alias pairs, each packed into a 64-bit word with the smaller pointer
+// ID in the high half. While it is filled, the set is a flat open-addressing
+// table probed a group of slots at a time. freeze() turns it into a sorted
+// vector without empty slots, searched by binary search, which is what the
+// set should be once the analysis is done with it. Inserting into a frozen
+// set turns it back into a table.
+class AliasPairSet
+{
+private:
+    // 0 marks an empty slot, which no pair packs to since pointer ID 0 is
+    // reserved
+    std::vector<std::uint64_t> slots;
+    std::size_t numPairs = 0;
+    bool frozen = false;
+
+    void rehash(std::size_t numGroups);
+    void thaw();
+    bool insertPacked(std::uint64_t);
+
+public:
+    // Number of slots probed at once
+    static constexpr unsigned groupSize = 4;
+
+    static std::uint64_t packPair(const AliasPair& pair) {
+        return (std::uint64_t(pair.getFirst()) << 32) | pair.getSecond();
+    }
+    static AliasPair unpackPair(std::uint64_t packed) {
+        return AliasPair(packed >> 32, packed & 0xffffffff);
+    }
+
+    // Visits the pairs in no particular order, or in increasing order of their
+    // packed form if the set is frozen
+    class const_iterator
+    {
+    private:
+        const std::uint64_t* pos;
+        const std::uint64_t* end;
+
+        void skipEmpty() {
+            while (pos != end && *pos == 0)
+                ++pos;
+        }
+
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = AliasPair;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = AliasPair;
+
+        const_iterator(const std::uint64_t* p, const std::uint64_t* e)
+            : pos(p), end(e) {
+            skipEmpty();
+        }
+
+        AliasPair operator*() const { return unpackPair(*pos); }
+        std::uint64_t getPacked() const { return *pos; }
+        const_iterator& operator++() {
+            ++pos;
+            skipEmpty();
+            return *this;
+        }
+        const_iterator operator++(int) {
+            auto ret = *this;
+            ++*this;
+            return ret;
+        }
+        bool operator==(const const_iterator& rhs) const {
+            return pos == rhs.pos;
+        }
+        bool operator!=(const const_iterator& rhs) const {
+            return pos != rhs.pos;
+        }
+    };
+
+    // Returns whether the pair was not in the set yet
+    bool insert(const AliasPair& pair) { return insertPacked(packPair(pair)); }
+    template <typename InputIterator>
+    void insert(InputIterator begin, InputIterator end) {
+        for (; begin != end; ++begin)
+            insert(*begin);
+    }
+    void insert(const AliasPairSet&);
+    // Add the sorted, packed pairs [begin, end). The set is left frozen.
+    void insertSorted(const std::uint64_t* begin, const std::uint64_t* end);
+
+    bool count(const AliasPair&) const;
+    // Make room for numPairs pairs without growing again
+    void reserve(std::size_t numPairs);
+    void freeze();
+    bool isFrozen() const { return frozen; }
+    void clear();
+
+    // Bytes allocated for the pairs
+    std::size_t getMemoryUsage() const {
+        return slots.capacity() * sizeof(std::uint64_t);
+    }
+    std::size_t size() const { return numPairs; }
+    bool empty() const { return numPairs == 0; }
+    const_iterator begin() const {
+        return const_iterator(slots.data(), slots.data() + slots.size());
+    }
+    const_iterator end() const {
+        return const_iterator(slots.data() + slots.size(),
+                              slots.data() + slots.size());
+    }
+};
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Dynamic/Analysis/AliasPairSet.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dynamic {
+
+class DynamicAliasAnalysis;
+
+// The alias pairs found by the dynamic analysis in a compact binary form. The
+// pairs of every function are kept sorted, packed into 64-bit words with the
+// smaller pointer ID in the high half, so that result files of many runs can
+// be merged without decoding them.
+class AliasResultFile
+{
+public:
+    struct FunctionEntry
+    {
+        std::uint32_t id;
+        std::uint32_t reserved;
+        // The pairs of the function are pairs[firstPair, firstPair + numPairs)
+        std::uint64_t firstPair;
+        std::uint64_t numPairs;
+    };
+
+private:
+    // Sorted by function ID, without functions that have no pairs
+    std::vector<FunctionEntry> functions;
+    std::vector<std::uint64_t> pairs;
+
+    AliasResultFile() = default;
+
+public:
+    static std::uint64_t packPair(const AliasPair& pair) {
+        return AliasPairSet::packPair(pair);
+    }
+    static AliasPair unpackPair(std::uint64_t packed) {
+        return AliasPairSet::unpackPair(packed);
+    }
+
+    static AliasResultFile fromAnalysis(const DynamicAliasAnalysis&);
+    // Union of the given results, computed on numThreads threads
+    static AliasResultFile merge(const std::vector<const AliasResultFile*>&,
+                                 unsigned numThreads = 1);
+
+    // Tell whether the file looks like an alias result file, as opposed to a
+    // log
+    static bool isResultFile(const char* fileName);
+    static AliasResultFile readFromFile(const char* fileName);
+    void writeToFile(const char* fileName) const;
+    // Write the given pair sets straight to a result file, without building
+    // the result in memory first. The functions must be sorted by ID and their
+    // sets frozen.
+    static void
+    writePairSets(const char* fileName,
+                  const std::vector<std::pair<DynamicPointer,
+                                              const AliasPairSet*>>& sets);
+    // Like fromAnalysis(dynAA).writeToFile(fileName)
+    static void writeAnalysis(const char* fileName,
+                              const DynamicAliasAnalysis& dynAA);
+
+    const std::vector<FunctionEntry>& getFunctions() const { return functions; }
+    std::uint64_t getNumPairs() const { return pairs.size(); }
+
+    // Return the sorted, packed pairs of the function with the given ID, or an
+    // empty range if it has none
+    std::pair<const std::uint64_t*, const std::uint64_t*>
+    getAliasPairs(DynamicPointer func) const;
+    std::vector<AliasPair> getUnpackedAliasPairs(DynamicPointer func) const;
+};
+
+// Reads a result file one function at a time, for results too large to be
+// read whole
+class AliasResultFileReader
+{
+private:
+    std::string fileName;
+    std::ifstream ifs;
+    std::vector<AliasResultFile::FunctionEntry> functions;
+    std::uint64_t pairsOffset;
+
+public:
+    AliasResultFileReader(const char* fileName);
+
+    const std::vector<AliasResultFile::FunctionEntry>& getFunctions() const {
+        return functions;
+    }
+    // Read the pairs of an entry of getFunctions()
+    void readAliasPairs(const AliasResultFile::FunctionEntry&,
+                        std::vector<std::uint64_t>& pairs);
+};
+}
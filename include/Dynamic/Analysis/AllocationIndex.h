@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dynamic {
+
+// Live allocations of a program, looked up by any address inside of them. The
+// allocations are disjoint: one that overlaps a new allocation must have been
+// freed for its memory to be handed out again, so it is dropped.
+//
+// The allocations are kept sorted by address in blocks of at most blockSize,
+// with the first address of every block in a vector of its own. A lookup is a
+// binary search over the blocks followed by one within a block, and an
+// insertion shifts at most one block, so both stay cheap with millions of
+// allocations. Allocations made at increasing addresses, which is what global
+// and stack memory mostly get, are appended without any search.
+class AllocationIndex
+{
+public:
+    struct Allocation
+    {
+        std::uintptr_t begin;
+        std::uintptr_t end;
+    };
+
+    static constexpr std::size_t blockSize = 256;
+
+private:
+    std::vector<std::vector<Allocation>> blocks;
+    std::vector<std::uintptr_t> blockBegins;
+    std::size_t numAllocations = 0;
+
+    // Pointers tend to stay within one object for a while, so the last
+    // allocation found is checked before searching
+    mutable Allocation lastFound = {0, 0};
+
+    std::size_t findBlock(std::uintptr_t addr) const;
+    void append(const Allocation&);
+    void eraseOverlapping(const Allocation&);
+
+public:
+    // Add the allocation [addr, addr + size). size must not be 0.
+    void insert(const void* addr, std::size_t size);
+
+    // The allocation containing addr, or nullptr if there is none
+    const Allocation* find(const void* addr) const;
+    // The start of the allocation containing addr, or addr itself if there is
+    // none
+    const void* getBase(const void* addr) const {
+        auto a = reinterpret_cast<std::uintptr_t>(addr);
+        if (a - lastFound.begin < lastFound.end - lastFound.begin)
+            return reinterpret_cast<const void*>(lastFound.begin);
+        auto alloc = find(addr);
+        return alloc ? reinterpret_cast<const void*>(alloc->begin) : addr;
+    }
+
+    // Visit the allocations in increasing order of address
+    template <typename Function>
+    void forEach(Function f) const {
+        for (auto const& block : blocks)
+            for (auto const& alloc : block)
+                f(alloc);
+    }
+
+    void clear();
+
+    // Bytes allocated for the allocations
+    std::size_t getMemoryUsage() const {
+        return blocks.capacity() * sizeof(std::vector<Allocation>) +
+               blocks.size() * (blockSize + 1) * sizeof(Allocation) +
+               blockBegins.capacity() * sizeof(std::uintptr_t);
+    }
+    std::size_t size() const { return numAllocations; }
+    bool empty() const { return numAllocations == 0; }
+};
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Dynamic/Analysis/DynamicPointer.h"
+
+#include <llvm/ADT/DenseMap.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <utility>
+#include <vector>
+
+namespace dynamic {
+
+// Identifies a call string in a CallContextTable
+using ContextID = std::uint32_t;
+
+// Hash-consed table of call strings of at most maxDepth call sites, kept as a
+// trie: a context is its caller's context limited to the maxDepth - 1 most
+// recent call sites, followed by one more call site. Once the table holds
+// maxContexts contexts, new call strings are cut down to the longest recent
+// part already in the table, which is less precise but never fails.
+class CallContextTable
+{
+private:
+    struct Node
+    {
+        ContextID prefix;
+        DynamicPointer callSite;
+        unsigned depth;
+    };
+    std::vector<Node> nodes;
+    llvm::DenseMap<std::pair<ContextID, DynamicPointer>, ContextID> nodeMap;
+    // Memoized results of push(), dropped whenever it grows as large as the
+    // table itself
+    llvm::DenseMap<std::pair<ContextID, DynamicPointer>, ContextID> pushCache;
+
+    unsigned maxDepth;
+    std::size_t maxContexts;
+    std::uint64_t numDegraded;
+
+    ContextID intern(ContextID prefix, DynamicPointer callSite, bool create);
+    ContextID keepRecent(ContextID ctx, unsigned depth, bool create);
+
+public:
+    static constexpr ContextID EmptyContext = 0;
+    static constexpr ContextID InvalidContext = ~0u;
+
+    CallContextTable(unsigned maxDepth = 0, std::size_t maxContexts = 1 << 20);
+
+    unsigned getMaxDepth() const { return maxDepth; }
+    std::size_t size() const { return nodes.size(); }
+    // Number of calls whose context had to be cut short to stay within
+    // maxContexts
+    std::uint64_t getNumDegraded() const { return numDegraded; }
+
+    // The context of a callee called at callSite by a caller in context caller
+    ContextID push(ContextID caller, DynamicPointer callSite);
+    // The part of ctx made of its depth most recent call sites, or
+    // InvalidContext if the table does not hold it
+    ContextID findRecent(ContextID ctx, unsigned depth);
+
+    unsigned getDepth(ContextID ctx) const { return nodes[ctx].depth; }
+    // Call sites of the context, the least recent first
+    std::vector<DynamicPointer> getCallSites(ContextID ctx) const;
+
+    void writeTo(std::ostream&) const;
+    void readFrom(std::istream&);
+};
+}
@@ -1,18 +1,43 @@
 #pragma once
 
-#include "Dynamic/Analysis/AliasPair.h"
+#include "Dynamic/Analysis/AliasPairSet.h"
+#include "Dynamic/Analysis/CallContext.h"
 
 #include <llvm/ADT/DenseMap.h>
-#include <llvm/ADT/DenseSet.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
 
 namespace dynamic {
 
+class LogIndex;
+
 class DynamicAliasAnalysis
 {
+public:
+    using PairListener = std::function<void(
+        DynamicPointer func, const std::vector<AliasPair>& pairs)>;
+
 private:
-    using AliasPairSet = llvm::DenseSet<AliasPair>;
     using AnalysisMap = llvm::DenseMap<DynamicPointer, AliasPairSet>;
     AnalysisMap aliasPairMap;
+    using ContextKey = std::pair<DynamicPointer, ContextID>;
+    using ContextAnalysisMap = llvm::DenseMap<ContextKey, AliasPairSet>;
+    ContextAnalysisMap contextAliasPairMap;
+
+    CallContextTable contextTable;
+    std::size_t maxContextSummaries;
+    std::uint64_t numDegradedSummaries;
+
+    std::size_t memoryBudget;
+    std::string spillDirectory;
+    std::uint64_t numSpilledRuns;
+    std::uint64_t numSpilledFrames;
+
+    bool objectGranularity;
+    PairListener pairListener;
 
     const char* fileName;
 
@@ -21,10 +46,86 @@ public:
 
     DynamicAliasAnalysis(const char* fileName);
 
-    void runAnalysis();
+    // Keep a summary per function and call string of up to depth call sites,
+    // in addition to the summary per function. Beyond maxContexts call strings
+    // or maxSummaries summaries, functions fall back to shorter call strings.
+    // Must be set before the analysis is run.
+    void setContextSensitivity(unsigned depth, std::size_t maxContexts,
+                               std::size_t maxSummaries);
+    // Keep the estimated memory use of runAnalysis(), runCheckpointedAnalysis()
+    // and runAnalysisOnShard() below budget bytes (0 for no bound), at the cost
+    // of some speed. Past the budget, the alias pairs found so far and the
+    // local maps of frames deep in the stack are spilled to files in
+    // spillDirectory, or $TMPDIR if it is empty, which also holds the pairs
+    // spilled before a checkpoint that is resumed from. Cannot be combined with
+    // context sensitivity or runAnalysisOnFunctions().
+    void setMemoryBudget(std::size_t budget, const std::string& spillDirectory);
+    // Report two pointers as aliases whenever they point into the same
+    // allocation, rather than only when they point to the same address. Only
+    // allocations whose size has been logged are told apart from the addresses
+    // around them. Only supported by runAnalysis() and
+    // runCheckpointedAnalysis().
+    void setObjectGranularity(bool enabled) { objectGranularity = enabled; }
+    // Call listener with the pairs each completed frame adds to the summary of
+    // its function, as soon as the frame has been searched, so that they can
+    // be consumed while the analysis goes on. With several workers, the
+    // listener is called by the worker threads, possibly at the same time. A
+    // pair may be passed again, e.g. for another call string of the function
+    // or after the summaries have been spilled.
+    void setPairListener(PairListener listener) {
+        pairListener = std::move(listener);
+    }
+
+    // If numDecoders is non-zero, the log is decoded by that many threads in
+    // parallel with the analysis, unless the memory is bounded. If numWorkers
+    // is greater than one, the completed frames are searched for alias pairs
+    // by that many threads.
+    void runAnalysis(unsigned numDecoders = 0, unsigned numWorkers = 1);
+    // Like runAnalysis(), but save the state of the analysis to checkpointFile
+    // every checkpointInterval bytes of log and once the end of the log is
+    // reached. If resumeFile is given, the analysis continues from the state
+    // saved there, which also picks up records appended to the log since the
+    // checkpoint was taken. Either file name may be null.
+    void runCheckpointedAnalysis(const char* checkpointFile,
+                                 std::uint64_t checkpointInterval,
+                                 const char* resumeFile,
+                                 unsigned numWorkers = 1);
+    // Only analyze the frames of the given functions, which are located
+    // through an index of the log. Only their summaries are kept.
+    void runAnalysisOnFunctions(const LogIndex&,
+                                const std::vector<DynamicPointer>& funcs);
+    // Only analyze the records in [beginOffset, endOffset) of the log, which
+    // must both be record boundaries, after the globals allocated before. The
+    // frames open at either end of the shard are saved to partialFramesFile
+    // instead of being searched.
+    void runAnalysisOnShard(const LogIndex&, std::uint64_t beginOffset,
+                            std::uint64_t endOffset,
+                            const char* partialFramesFile,
+                            unsigned numWorkers = 1);
+    // Put together the frames saved by the shards of a log and analyze the
+    // ones that exit
+    void
+    reducePartialFrames(const LogIndex&,
+                        const std::vector<std::string>& partialFramesFiles);
 
     const AliasPairSet* getAliasPairs(DynamicPointer) const;
 
+    // Summaries per function and call string, only filled in with context
+    // sensitivity
+    const ContextAnalysisMap& getContextAliasPairs() const {
+        return contextAliasPairMap;
+    }
+    const CallContextTable& getContextTable() const { return contextTable; }
+    // Number of frames summarized under a shorter call string than their own
+    // to stay within maxSummaries
+    std::uint64_t getNumDegradedSummaries() const {
+        return numDegradedSummaries;
+    }
+    // Number of times the alias pairs and frames were spilled to stay within
+    // the memory budget
+    std::uint64_t getNumSpilledRuns() const { return numSpilledRuns; }
+    std::uint64_t getNumSpilledFrames() const { return numSpilledFrames; }
+
     const_iterator begin() const { return aliasPairMap.begin(); }
     const_iterator end() const { return aliasPairMap.end(); }
 };
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <llvm/ADT/SmallVector.h>
+
+#include <cstddef>
+
+namespace dynamic {
+
+// Points-to set of a pointer within one frame. Addresses are appended as they
+// are logged and only sorted and deduplicated by normalize(), which the
+// analysis calls once the frame has exited. Until then, a pointer that keeps
+// pointing to the same address in a loop costs nothing but a comparison, and
+// the set compacts itself whenever it runs out of room, so duplicates cannot
+// pile up.
+class PtsSet
+{
+private:
+    llvm::SmallVector<const void*, 4> addrs;
+    // addrs[0, numSorted) is sorted and free of duplicates
+    unsigned numSorted = 0;
+
+public:
+    using const_iterator = const void* const*;
+
+    void insert(const void* addr) {
+        if (!addrs.empty() && addrs.back() == addr)
+            return;
+        // Only grow if deduplicating does not free half of the room, so that
+        // a set of nearly as many distinct addresses as it has room for is
+        // not sorted again on every insertion
+        if (addrs.size() == addrs.capacity()) {
+            normalize();
+            if (addrs.size() * 2 > addrs.capacity())
+                addrs.reserve(addrs.capacity() * 2);
+        }
+        addrs.push_back(addr);
+    }
+
+    // Sort the addresses and drop the duplicates
+    void normalize();
+    bool isNormalized() const { return numSorted == addrs.size(); }
+
+    // Whether the sets share an address. Both sets must be normalized.
+    bool intersects(const PtsSet&) const;
+
+    // Keeps the storage around for reuse
+    void clear() {
+        addrs.clear();
+        numSorted = 0;
+    }
+
+    // Bytes allocated outside of the set itself
+    std::size_t getMemoryUsage() const {
+        return addrs.capacity() > 4 ? addrs.capacity() * sizeof(const void*)
+                                    : 0;
+    }
+    std::size_t size() const { return addrs.size(); }
+    bool empty() const { return addrs.empty(); }
+    // Visits the addresses in increasing order if the set is normalized, with
+    // duplicates otherwise
+    const_iterator begin() const { return addrs.begin(); }
+    const_iterator end() const { return addrs.end(); }
+};
+}
@@ -2,6 +2,7 @@
 
 #include <llvm/ADT/DenseMap.h>
 #include <cstdint>
+#include <vector>
 
 namespace llvm {
 class Module;
@@ -13,9 +14,19 @@ namespace dynamic {
 
 using IDType = std::uint32_t;
 
+// Modules that are instrumented separately and linked together afterwards
+// keep their IDs apart by storing a module ID in the high bits of every ID.
+// Module ID 0 stands for a whole-program module and may use the entire ID
+// space.
+constexpr unsigned ModuleIDBits = 10;
+constexpr unsigned LocalIDBits = sizeof(IDType) * 8 - ModuleIDBits;
+constexpr unsigned MaxModuleID = (1u << ModuleIDBits) - 1;
+
 class IDAssigner
 {
 private:
+    IDType startID;
+    IDType endID;
     IDType nextID;
 
     using MapType = llvm::DenseMap<const llvm::Value*, IDType>;
@@ -27,7 +38,7 @@ private:
     bool assignUserID(const llvm::User*);
 
 public:
-    IDAssigner(const llvm::Module&);
+    IDAssigner(const llvm::Module&, unsigned moduleID = 0);
 
     const IDType* getID(const llvm::Value& v) const;
     const llvm::Value* getValue(IDType id) const;
@@ -9,8 +9,12 @@ namespace dynamic {
 class MemoryInstrument
 {
 private:
+    unsigned moduleID;
+    bool skipLocalAllocas;
+
 public:
-    MemoryInstrument() = default;
+    MemoryInstrument(unsigned m = 0, bool s = true)
+        : moduleID(m), skipLocalAllocas(s) {}
 
     void runOnModule(llvm::Module&);
 };
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Dynamic/Log/LogReader.h"
+#include "Dynamic/Log/LogRecord.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dynamic
+{
+
+// A log converted into a structure-of-arrays layout. Each field of the records
+// lives in a column of its own, so a scan only touches the columns it needs.
+// Fields a record does not have are stored as zero. Every column starts at a
+// 64-byte aligned file offset, which keeps loops over a mapped column
+// vectorizable.
+//
+// Frames are numbered in the order of their EnterRecords. The frame table holds
+// the record index of each EnterRecord and of its matching ExitRecord, which is
+// the next ExitRecord of the same thread at the same depth. A frame that never
+// exits ends at getNumRecords().
+struct ColumnarLogHeader
+{
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t reserved;
+	std::uint64_t numRecords;
+	std::uint64_t numFrames;
+	std::uint64_t typeOffset;
+	std::uint64_t allocTypeOffset;
+	std::uint64_t idOffset;
+	std::uint64_t addressOffset;
+	std::uint64_t frameBeginOffset;
+	std::uint64_t frameEndOffset;
+	std::uint64_t sizeOffset;
+};
+
+class ColumnarLogWriter
+{
+public:
+	ColumnarLogWriter() = delete;
+
+	// Convert the log into the columnar format and write it to outFileName
+	static void convert(const MappedLogReader& reader, const char* outFileName);
+};
+
+class ColumnarLog
+{
+private:
+	void* mapping;
+	std::size_t mappingSize;
+
+	const ColumnarLogHeader* header;
+
+	template <typename T>
+	const T* getColumn(std::uint64_t offset) const
+	{
+		return reinterpret_cast<const T*>(static_cast<const char*>(mapping) + offset);
+	}
+public:
+	ColumnarLog(const char* fileName);
+	~ColumnarLog();
+
+	ColumnarLog(const ColumnarLog&) = delete;
+	ColumnarLog& operator=(const ColumnarLog&) = delete;
+
+	std::uint64_t getNumRecords() const { return header->numRecords; }
+	std::uint64_t getNumFrames() const { return header->numFrames; }
+
+	// LogRecordType of every record
+	const std::uint8_t* types() const { return getColumn<std::uint8_t>(header->typeOffset); }
+	// AllocType of every AllocRecord
+	const std::uint8_t* allocTypes() const { return getColumn<std::uint8_t>(header->allocTypeOffset); }
+	const std::uint32_t* ids() const { return getColumn<std::uint32_t>(header->idOffset); }
+	const std::uint64_t* addresses() const { return getColumn<std::uint64_t>(header->addressOffset); }
+	// Allocation size of every AllocRecord, 0 if unknown
+	const std::uint64_t* sizes() const { return getColumn<std::uint64_t>(header->sizeOffset); }
+
+	const std::uint64_t* frameBegins() const { return getColumn<std::uint64_t>(header->frameBeginOffset); }
+	const std::uint64_t* frameEnds() const { return getColumn<std::uint64_t>(header->frameEndOffset); }
+
+	// Reassemble the i-th record
+	LogRecord getRecord(std::uint64_t i) const;
+};
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Dynamic/Log/LogRecord.h"
+
+#include <cstdint>
+#include <limits>
+#include <unordered_set>
+
+namespace dynamic
+{
+
+// Select the records of interest by type, ID, address and position in the log.
+// A default-constructed filter accepts every record.
+class LogFilter
+{
+private:
+	unsigned typeMask;
+	std::unordered_set<unsigned> ids;
+	bool hasAddressRange;
+	std::uintptr_t minAddress, maxAddress;
+	std::uint64_t firstIndex, lastIndex;
+
+	bool acceptsCommon(std::uint64_t index, LogRecordType type, unsigned id) const
+	{
+		return index >= firstIndex && index < lastIndex && (typeMask & (1u << type)) && (ids.empty() || ids.count(id));
+	}
+public:
+	LogFilter(): typeMask(~0u), hasAddressRange(false), minAddress(0), maxAddress(std::numeric_limits<std::uintptr_t>::max()), firstIndex(0), lastIndex(std::numeric_limits<std::uint64_t>::max()) {}
+
+	// Only accept the record types whose bits (1 << LogRecordType) are set
+	void setTypeMask(unsigned mask) { typeMask = mask; }
+	// Only accept records with one of the added IDs
+	void addID(unsigned id) { ids.insert(id); }
+	// Only accept records that carry an address within [lo, hi]
+	void setAddressRange(std::uintptr_t lo, std::uintptr_t hi)
+	{
+		hasAddressRange = true;
+		minAddress = lo;
+		maxAddress = hi;
+	}
+	// Only accept the records numbered [first, last) in log order
+	void setIndexWindow(std::uint64_t first, std::uint64_t last)
+	{
+		firstIndex = first;
+		lastIndex = last;
+	}
+
+	bool hasIndexWindow() const { return firstIndex != 0 || lastIndex != std::numeric_limits<std::uint64_t>::max(); }
+	// Whether any of the records numbered [first, last) may be accepted
+	bool overlapsIndexWindow(std::uint64_t first, std::uint64_t last) const { return first < lastIndex && last > firstIndex; }
+
+	// For records without an address
+	bool accepts(std::uint64_t index, LogRecordType type, unsigned id) const
+	{
+		return !hasAddressRange && acceptsCommon(index, type, id);
+	}
+
+	bool accepts(std::uint64_t index, LogRecordType type, unsigned id, const void* address) const
+	{
+		auto addr = reinterpret_cast<std::uintptr_t>(address);
+		return addr >= minAddress && addr <= maxAddress && acceptsCommon(index, type, id);
+	}
+};
+
+}
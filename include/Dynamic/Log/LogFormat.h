@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Dynamic/Log/LogRecord.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace dynamic
+{
+
+// On disk, a record is a one-byte type tag followed by the fields of the
+// record, packed without any padding. See writeLogRecord() in the runtime.
+
+template <typename T>
+static inline const char* decodeField(const char* pos, T* data)
+{
+	std::memcpy(data, pos, sizeof(T));
+	return pos + sizeof(T);
+}
+
+// Return the encoded size of a record of the given type, including the type tag
+static inline std::size_t getEncodedRecordSize(char type)
+{
+	switch (type)
+	{
+		case TAllocRec:
+			return 1 + sizeof(char) + sizeof(unsigned) + sizeof(void*);
+		case TSizedAllocRec:
+			return 1 + sizeof(char) + sizeof(unsigned) + sizeof(void*) + sizeof(size_t);
+		case TPointerRec:
+			return 1 + sizeof(unsigned) + sizeof(void*);
+		case TEnterRec:
+		case TExitRec:
+		case TCallRec:
+		case TThreadRec:
+			return 1 + sizeof(unsigned);
+		default:
+		{
+			std::cerr << static_cast<unsigned>(type) << std::endl;
+			std::cerr << "Illegal record type. Log file must be broken.\n";
+			std::exit(-1);
+		}
+	}
+}
+
+// Decode the record starting at pos into rec. Return the position of the next
+// record, or nullptr if the record is cut off by the end of the buffer.
+static inline const char* decodeLogRecord(const char* pos, const char* end, LogRecord& rec)
+{
+	auto type = *pos;
+	if (static_cast<std::size_t>(end - pos) < getEncodedRecordSize(type))
+		return nullptr;
+
+	rec.type = static_cast<LogRecordType>(type);
+	++pos;
+	switch (type)
+	{
+		case TAllocRec:
+			pos = decodeField(pos, &rec.allocRecord.type);
+			pos = decodeField(pos, &rec.allocRecord.id);
+			pos = decodeField(pos, &rec.allocRecord.address);
+			rec.allocRecord.size = 0;
+			break;
+		case TSizedAllocRec:
+			rec.type = TAllocRec;
+			pos = decodeField(pos, &rec.allocRecord.type);
+			pos = decodeField(pos, &rec.allocRecord.id);
+			pos = decodeField(pos, &rec.allocRecord.address);
+			pos = decodeField(pos, &rec.allocRecord.size);
+			break;
+		case TPointerRec:
+			pos = decodeField(pos, &rec.ptrRecord.id);
+			pos = decodeField(pos, &rec.ptrRecord.address);
+			break;
+		case TEnterRec:
+			pos = decodeField(pos, &rec.enterRecord.id);
+			break;
+		case TExitRec:
+			pos = decodeField(pos, &rec.exitRecord.id);
+			break;
+		case TCallRec:
+			pos = decodeField(pos, &rec.callRecord.id);
+			break;
+		case TThreadRec:
+			pos = decodeField(pos, &rec.threadRecord.id);
+			break;
+	}
+	return pos;
+}
+
+}
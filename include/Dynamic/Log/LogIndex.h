@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Dynamic/Log/LogReader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dynamic
+{
+
+// Locates the frames of every function in a log, so that the frames of a few
+// functions can be looked at without replaying the whole log. Offsets are byte
+// offsets into the log file.
+class LogIndex
+{
+public:
+	struct FrameEntry
+	{
+		// Offset of the EnterRecord of the frame
+		std::uint64_t enterOffset;
+		// Offset of the matching ExitRecord, or the log size if the frame never
+		// exits
+		std::uint64_t exitOffset;
+	};
+
+	struct FunctionEntry
+	{
+		std::uint32_t id;
+		std::uint32_t reserved;
+		// The frames of the function are frames[firstFrame, firstFrame + numFrames),
+		// in log order
+		std::uint64_t firstFrame;
+		std::uint64_t numFrames;
+	};
+
+	struct OpenFrame
+	{
+		std::uint32_t func;
+		FrameEntry entry;
+	};
+private:
+	std::uint64_t logSize;
+	unsigned numThreads;
+	// Sorted by function ID
+	std::vector<FunctionEntry> functions;
+	std::vector<FrameEntry> frames;
+	// Offsets of the AllocRecords of globals, which every frame may depend on
+	std::vector<std::uint64_t> globalOffsets;
+
+	LogIndex() = default;
+public:
+	// Index the log in a single pass
+	static LogIndex build(const MappedLogReader& reader);
+	static LogIndex readFromFile(const char* fileName);
+	void writeToFile(const char* fileName) const;
+
+	std::uint64_t getLogSize() const { return logSize; }
+	// Number of threads that logged records. The frames of different threads
+	// interleave in the log, which getOpenFrames() does not tell apart.
+	unsigned getNumThreads() const { return numThreads; }
+
+	// Return the frames of the function with the given ID, or an empty range if
+	// it never runs
+	std::pair<const FrameEntry*, const FrameEntry*> getFrames(std::uint32_t id) const;
+	// Return the frames entered before the given offset that have not exited
+	// before it, from the bottom of the stack up
+	std::vector<OpenFrame> getOpenFrames(std::uint64_t offset) const;
+	// Return the offset of the ExitRecord of the frame of the given function
+	// entered at enterOffset, or the log size if it never exits
+	std::uint64_t getExitOffset(std::uint32_t id, std::uint64_t enterOffset) const;
+
+	const std::vector<FunctionEntry>& getFunctions() const { return functions; }
+	const std::vector<std::uint64_t>& getGlobalOffsets() const { return globalOffsets; }
+};
+
+}
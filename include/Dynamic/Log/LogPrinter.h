@@ -1,7 +1,11 @@
 #pragma once
 
+#include "Dynamic/Log/LogFilter.h"
 #include "Dynamic/Log/LogProcessor.h"
 
+#include <cstdint>
+#include <vector>
+
 namespace dynamic
 {
 
@@ -9,14 +13,32 @@ class LogPrinter: public LogProcessor<LogPrinter>
 {
 private:
 	std::ostream& os;
+	LogFilter filter;
+	std::uint64_t numRecordsSeen;
+
+	// Records are rendered into the buffer by hand, which is a lot faster than
+	// going through the stream's formatting for every field
+	std::vector<char> buffer;
+	std::size_t bufferUsed;
+
+	void append(const char* str);
+	void appendDecimal(std::uint64_t num);
+	void appendAddress(const void* addr);
+	void endLine();
 public:
-	LogPrinter(const char*, std::ostream&);
+	LogPrinter(const char*, std::ostream&, LogFilter f = LogFilter());
+	~LogPrinter();
+
+	void flush();
+
+	void visitBatch(const LogRecord* begin, const LogRecord* end);
 
 	void visitAllocRecord(const AllocRecord&);
 	void visitPointerRecord(const PointerRecord&);
 	void visitEnterRecord(const EnterRecord&);
 	void visitExitRecord(const ExitRecord&);
 	void visitCallRecord(const CallRecord&);
+	void visitThreadRecord(const ThreadRecord&);
 };
 
 }
@@ -2,6 +2,9 @@
 
 #include "Dynamic/Log/LogReader.h"
 #include "Dynamic/Log/LogVisitor.h"
+#include "Dynamic/Log/ParallelLogReader.h"
+
+#include <array>
 
 namespace dynamic
 {
@@ -10,14 +13,81 @@ template <typename SubClass, typename RetType = void>
 class LogProcessor: public LogConstVisitor<SubClass, RetType>
 {
 private:
-	LazyLogReader reader;
+	MappedLogReader reader;
+
+	// Decode the records [itr, ite) into batches and hand them to visitBatch(),
+	// stopping early at the first record that starts at or after stop. Return
+	// the position right after the last record visited.
+	const char* processBatches(MappedLogReader::const_iterator itr, MappedLogReader::const_iterator ite, const char* stop)
+	{
+		std::array<LogRecord, 1024> batch;
+		auto processed = itr.getPosition();
+		while (itr != ite && itr.getPosition() < stop)
+		{
+			auto batchEnd = batch.begin();
+			for (; itr != ite && itr.getPosition() < stop && batchEnd != batch.end(); ++itr, ++batchEnd)
+			{
+				*batchEnd = *itr;
+				processed = itr.getNextPosition();
+			}
+			static_cast<SubClass*>(this)->visitBatch(batch.data(), batchEnd);
+		}
+		return processed;
+	}
+	const char* processBatches(MappedLogReader::const_iterator itr, MappedLogReader::const_iterator ite)
+	{
+		return processBatches(itr, ite, reader.data() + reader.size());
+	}
 public:
-	LogProcessor(const char* fileName): reader(fileName) {}
+	LogProcessor(const char* fileName, bool useHugePages = false): reader(fileName, useHugePages) {}
+
+	std::size_t getLogSize() const { return reader.size(); }
+	const MappedLogReader& getReader() const { return reader; }
+	// Release the memory holding the part of the log before the given offset,
+	// which is assumed to have been visited already
+	void dropLogBefore(std::size_t offset) { reader.dropPagesBefore(offset); }
 
 	void process()
 	{
-		while (auto rec = reader.readLogRecord())
-			this->visit(*rec);
+		processBatches(reader.begin(), reader.end());
+	}
+
+	// Visit the records in the byte range [beginOffset, endOffset) of the log.
+	// Both offsets must be record boundaries.
+	void processRange(std::size_t beginOffset, std::size_t endOffset)
+	{
+		processBatches(reader.at(beginOffset), reader.at(endOffset));
+	}
+
+	// Visit the single record that starts at the given offset
+	void processRecordAt(std::size_t offset)
+	{
+		processRange(offset, offset + getEncodedRecordSize(reader.data()[offset]));
+	}
+
+	// Visit the complete records from the record boundary beginOffset on, up to
+	// the first record that starts at or after stopOffset. Return the offset
+	// where the next call should start, which is less than stopOffset if the log
+	// ends in a record that is not completely written yet.
+	std::size_t processUntil(std::size_t beginOffset, std::size_t stopOffset)
+	{
+		auto itr = reader.at(beginOffset);
+		// Nothing but an incomplete record left
+		if (itr == reader.end())
+			return beginOffset;
+		return processBatches(itr, reader.end(), reader.data() + stopOffset) - reader.data();
+	}
+
+	// Decode the log on numDecoders worker threads while the records are
+	// visited on the calling thread, in the same order as process() does
+	void process(unsigned numDecoders)
+	{
+		if (numDecoders == 0)
+			return process();
+
+		ParallelLogReader parallelReader(reader, numDecoders);
+		while (auto batch = parallelReader.nextBatch())
+			static_cast<SubClass*>(this)->visitBatch(batch->data(), batch->data() + batch->size());
 	}
 };
 
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "Dynamic/Log/LogFormat.h"
 #include "Dynamic/Log/LogRecord.h"
 
+#include <cstddef>
 #include <experimental/optional>
 #include <fstream>
+#include <iterator>
 #include <vector>
 
 namespace dynamic
@@ -27,4 +30,87 @@ public:
 	std::experimental::optional<LogRecord> readLogRecord();
 };
 
+// Read the log through a read-only memory mapping. Records are decoded
+// straight from the mapping as the iterator walks over it, so no copying or
+// per-record stream state is involved.
+class MappedLogReader
+{
+private:
+	void* mapping;
+	std::size_t mappingSize;
+
+	const char* logBegin;
+	const char* logEnd;
+public:
+	class const_iterator: public std::iterator<std::forward_iterator_tag, LogRecord, std::ptrdiff_t, const LogRecord*, const LogRecord&>
+	{
+	private:
+		const char* pos;
+		const char* next;
+		const char* end;
+		LogRecord rec;
+
+		void decode()
+		{
+			if (pos != end)
+			{
+				next = decodeLogRecord(pos, end, rec);
+				// A record cut off at the end of the log is treated as if it
+				// has not been written yet
+				if (next == nullptr)
+					pos = end;
+			}
+		}
+	public:
+		const_iterator(const char* p, const char* e): pos(p), next(p), end(e)
+		{
+			decode();
+		}
+
+		const LogRecord& operator*() const { return rec; }
+		const LogRecord* operator->() const { return &rec; }
+
+		const_iterator& operator++()
+		{
+			pos = next;
+			decode();
+			return *this;
+		}
+		const_iterator operator++(int)
+		{
+			auto ret = *this;
+			++*this;
+			return ret;
+		}
+
+		// Position of the current record in the log
+		const char* getPosition() const { return pos; }
+		// Position right after the current record
+		const char* getNextPosition() const { return next; }
+
+		bool operator==(const const_iterator& rhs) const { return pos == rhs.pos; }
+		bool operator!=(const const_iterator& rhs) const { return pos != rhs.pos; }
+	};
+
+	// If useHugePages is set, ask the kernel to back the mapping with
+	// transparent huge pages where the filesystem supports it
+	MappedLogReader(const char* fileName, bool useHugePages = false);
+	~MappedLogReader();
+
+	MappedLogReader(const MappedLogReader&) = delete;
+	MappedLogReader& operator=(const MappedLogReader&) = delete;
+
+	const char* data() const { return logBegin; }
+	std::size_t size() const { return logEnd - logBegin; }
+
+	const_iterator begin() const { return const_iterator(logBegin, logEnd); }
+	const_iterator end() const { return const_iterator(logEnd, logEnd); }
+	// Return an iterator to the record starting at the given byte offset
+	const_iterator at(std::size_t offset) const { return const_iterator(logBegin + offset, logEnd); }
+
+	// Let the kernel drop the pages of the log before the given byte offset
+	// from memory. They are read from the file again if they are touched.
+	void dropPagesBefore(std::size_t offset);
+};
+
 }
@@ -2,11 +2,15 @@
 
 // We won't put the following structs into a namespace because of C compatibility
 
+#include <stddef.h>
+
 struct AllocRecord
 {
 	char type;
 	unsigned id;
 	void* address;
+	// Number of bytes allocated, or 0 if unknown
+	size_t size;
 };
 
 struct PointerRecord
@@ -30,13 +34,25 @@ struct CallRecord
 	unsigned id;
 };
 
+// The records following a ThreadRecord, up to the next one, were logged by the
+// thread with the given ID. Threads are numbered in the order they first log
+// something, and a log starts out in thread 0.
+struct ThreadRecord
+{
+	unsigned id;
+};
+
 enum LogRecordType
 {
 	TAllocRec,
 	TPointerRec,
 	TEnterRec,
 	TExitRec,
-	TCallRec
+	TCallRec,
+	TThreadRec,
+	// An AllocRecord with its size. This type only exists in log files: it is
+	// decoded into a TAllocRec, whose size is 0 when decoded from a TAllocRec.
+	TSizedAllocRec
 };
 
 struct LogRecord
@@ -49,5 +65,6 @@ struct LogRecord
 		struct EnterRecord enterRecord;
 		struct ExitRecord exitRecord;
 		struct CallRecord callRecord;
+		struct ThreadRecord threadRecord;
 	};
 };
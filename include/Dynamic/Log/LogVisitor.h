@@ -2,6 +2,8 @@
 
 #include "Dynamic/Log/LogRecord.h"
 
+#include <cstdlib>
+
 namespace dynamic
 {
 
@@ -25,10 +27,84 @@ public:
 				return static_cast<SubClass*>(this)->visitExitRecord(rec.exitRecord);
 			case LogRecordType::TCallRec:
 				return static_cast<SubClass*>(this)->visitCallRecord(rec.callRecord);
+			case LogRecordType::TThreadRec:
+				return static_cast<SubClass*>(this)->visitThreadRecord(rec.threadRecord);
 			default:
 				std::abort();
 		}
 	}
+
+	// Visit the records [begin, end) in order. The batch is cut into runs of
+	// records of the same type, and each run is handed to the loop of its type
+	// below, so the type dispatch happens once per run rather than once per
+	// record. Subclasses may override the loops to hoist per-type work out of
+	// them, or visitBatch() itself to look at the batch as a whole.
+	void visitBatch(const LogRecord* begin, const LogRecord* end)
+	{
+		while (begin != end)
+		{
+			auto type = begin->type;
+			auto runEnd = begin + 1;
+			while (runEnd != end && runEnd->type == type)
+				++runEnd;
+
+			switch (type)
+			{
+				case LogRecordType::TAllocRec:
+					static_cast<SubClass*>(this)->visitAllocRecords(begin, runEnd);
+					break;
+				case LogRecordType::TPointerRec:
+					static_cast<SubClass*>(this)->visitPointerRecords(begin, runEnd);
+					break;
+				case LogRecordType::TEnterRec:
+					static_cast<SubClass*>(this)->visitEnterRecords(begin, runEnd);
+					break;
+				case LogRecordType::TExitRec:
+					static_cast<SubClass*>(this)->visitExitRecords(begin, runEnd);
+					break;
+				case LogRecordType::TCallRec:
+					static_cast<SubClass*>(this)->visitCallRecords(begin, runEnd);
+					break;
+				case LogRecordType::TThreadRec:
+					static_cast<SubClass*>(this)->visitThreadRecords(begin, runEnd);
+					break;
+				default:
+					std::abort();
+			}
+			begin = runEnd;
+		}
+	}
+
+	void visitAllocRecords(const LogRecord* begin, const LogRecord* end)
+	{
+		for (auto itr = begin; itr != end; ++itr)
+			static_cast<SubClass*>(this)->visitAllocRecord(itr->allocRecord);
+	}
+	void visitPointerRecords(const LogRecord* begin, const LogRecord* end)
+	{
+		for (auto itr = begin; itr != end; ++itr)
+			static_cast<SubClass*>(this)->visitPointerRecord(itr->ptrRecord);
+	}
+	void visitEnterRecords(const LogRecord* begin, const LogRecord* end)
+	{
+		for (auto itr = begin; itr != end; ++itr)
+			static_cast<SubClass*>(this)->visitEnterRecord(itr->enterRecord);
+	}
+	void visitExitRecords(const LogRecord* begin, const LogRecord* end)
+	{
+		for (auto itr = begin; itr != end; ++itr)
+			static_cast<SubClass*>(this)->visitExitRecord(itr->exitRecord);
+	}
+	void visitCallRecords(const LogRecord* begin, const LogRecord* end)
+	{
+		for (auto itr = begin; itr != end; ++itr)
+			static_cast<SubClass*>(this)->visitCallRecord(itr->callRecord);
+	}
+	void visitThreadRecords(const LogRecord* begin, const LogRecord* end)
+	{
+		for (auto itr = begin; itr != end; ++itr)
+			static_cast<SubClass*>(this)->visitThreadRecord(itr->threadRecord);
+	}
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Dynamic/Log/LogReader.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dynamic
+{
+
+// Cut a mapped log into chunks of roughly equal size at record boundaries.
+// Finding a record boundary only requires looking at the type tags, which is
+// much cheaper than decoding. Not thread-safe.
+class LogSplitter
+{
+private:
+	const char* splitPos;
+	const char* logEnd;
+	std::size_t chunkSize;
+	bool splitDone;
+public:
+	LogSplitter(const MappedLogReader& reader, std::size_t chunkSize);
+
+	// Cut the next chunk off the log into [begin, end). Return false if the whole
+	// log has been split already.
+	bool next(const char*& begin, const char*& end);
+	bool done() const { return splitDone; }
+};
+
+// Decode a mapped log on a pool of worker threads. The log is split into
+// chunks at record boundaries, each worker decodes whole chunks into record
+// batches, and the batches are handed out in log order, so that a consumer sees
+// exactly the same record sequence as with MappedLogReader.
+class ParallelLogReader
+{
+public:
+	using Batch = std::vector<LogRecord>;
+private:
+	struct Slot
+	{
+		Batch batch;
+		std::size_t chunkIndex;
+		bool ready;
+	};
+
+	LogSplitter splitter;
+	std::size_t numChunksSplit;
+
+	// Batches are decoded into a ring of slots. Chunk i goes into slot
+	// i % slots.size(), which bounds how far the workers can run ahead of the
+	// consumer.
+	std::vector<Slot> slots;
+	std::size_t nextChunkToConsume;
+	bool holdsSlot;
+	bool stopped;
+
+	std::mutex mutex;
+	std::condition_variable slotFreed;
+	std::condition_variable slotReady;
+
+	std::vector<std::thread> workers;
+
+	void runWorker();
+	void releaseSlot();
+public:
+	static constexpr std::size_t DefaultChunkSize = 1 << 20;
+
+	ParallelLogReader(const MappedLogReader& reader, unsigned numThreads, std::size_t chunkSize = DefaultChunkSize);
+	~ParallelLogReader();
+
+	ParallelLogReader(const ParallelLogReader&) = delete;
+	ParallelLogReader& operator=(const ParallelLogReader&) = delete;
+
+	// Return the next batch in log order, or nullptr at the end of the log. The
+	// batch stays valid until the next call.
+	const Batch* nextBatch();
+
+	// Call processChunk on every chunk of the log. The calls are made
+	// concurrently from numThreads threads, in no particular order.
+	static void forEachChunk(const MappedLogReader& reader, unsigned numThreads, const std::function<void(const char*, const char*)>& processChunk, std::size_t chunkSize = DefaultChunkSize);
+};
+
+}
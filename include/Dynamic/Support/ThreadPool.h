@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dynamic {
+
+// A fixed-size pool of worker threads with one task queue per worker. Tasks
+// are distributed over the queues round-robin, and an idle worker steals from
+// the queues of the others. submit() blocks while too many tasks are pending,
+// which bounds the memory held by queued tasks.
+class ThreadPool
+{
+private:
+    struct TaskQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex stateMutex;
+    std::condition_variable taskQueued;
+    std::condition_variable taskDone;
+    // Tasks sitting in a queue that no worker has claimed yet
+    std::size_t numQueued;
+    // Tasks submitted but not finished
+    std::size_t numPending;
+    std::size_t maxPending;
+    unsigned nextQueue;
+    bool stopping;
+    // The first exception thrown by a task, rethrown by wait()
+    std::exception_ptr taskError;
+
+    void runWorker(unsigned index);
+    std::function<void()> takeTask(unsigned index);
+
+public:
+    ThreadPool(unsigned numThreads, std::size_t maxPending);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned getNumThreads() const { return workers.size(); }
+
+    void submit(std::function<void()> task);
+    // Block until all submitted tasks have finished
+    void wait();
+};
+}
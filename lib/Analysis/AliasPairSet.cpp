@@ -0,0 +1,166 @@
+#include "Dynamic/Analysis/AliasPairSet.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace dynamic {
+
+namespace {
+
+constexpr unsigned groupSize = AliasPairSet::groupSize;
+
+// The slots of a group that hold a key and the slots that are empty, one bit
+// per slot
+struct GroupMatch
+{
+    unsigned key;
+    unsigned empty;
+};
+
+inline GroupMatch matchGroup(const std::uint64_t* group, std::uint64_t key) {
+    static_assert(groupSize == 4, "The probes below compare four slots");
+#if defined(__AVX2__)
+    auto slots = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(group));
+    auto keyEq = _mm256_cmpeq_epi64(slots, _mm256_set1_epi64x(key));
+    auto emptyEq = _mm256_cmpeq_epi64(slots, _mm256_setzero_si256());
+    return GroupMatch{
+        unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(keyEq))),
+        unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(emptyEq)))};
+#elif defined(__SSE2__)
+    // SSE2 only compares 32-bit lanes: a slot matches if both of its halves do
+    auto needle = _mm_set1_epi64x(key);
+    auto zero = _mm_setzero_si128();
+    GroupMatch match{0, 0};
+    for (auto i = 0u; i < groupSize; i += 2) {
+        auto slots =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(group + i));
+        auto keyEq = _mm_cmpeq_epi32(slots, needle);
+        keyEq = _mm_and_si128(
+            keyEq, _mm_shuffle_epi32(keyEq, _MM_SHUFFLE(2, 3, 0, 1)));
+        auto emptyEq = _mm_cmpeq_epi32(slots, zero);
+        emptyEq = _mm_and_si128(
+            emptyEq, _mm_shuffle_epi32(emptyEq, _MM_SHUFFLE(2, 3, 0, 1)));
+        match.key |= unsigned(_mm_movemask_pd(_mm_castsi128_pd(keyEq))) << i;
+        match.empty |= unsigned(_mm_movemask_pd(_mm_castsi128_pd(emptyEq)))
+                       << i;
+    }
+    return match;
+#else
+    GroupMatch match{0, 0};
+    for (auto i = 0u; i < groupSize; ++i) {
+        match.key |= unsigned(group[i] == key) << i;
+        match.empty |= unsigned(group[i] == 0) << i;
+    }
+    return match;
+#endif
+}
+
+inline std::size_t hashPacked(std::uint64_t packed) {
+    auto hash = packed * 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 32);
+}
+
+// Groups are filled from their first slot on, and are never emptied, so a
+// group with an empty slot ends the probe sequence of every key that hashes
+// to it or to an earlier group of the sequence
+std::size_t findSlot(const std::vector<std::uint64_t>& slots,
+                     std::uint64_t packed) {
+    auto groupMask = slots.size() / groupSize - 1;
+    for (auto group = hashPacked(packed) & groupMask;;
+         group = (group + 1) & groupMask) {
+        auto match = matchGroup(slots.data() + group * groupSize, packed);
+        if (match.key)
+            return group * groupSize + __builtin_ctz(match.key);
+        if (match.empty)
+            return group * groupSize + __builtin_ctz(match.empty);
+    }
+}
+}
+
+void AliasPairSet::rehash(std::size_t numGroups) {
+    std::vector<std::uint64_t> oldSlots(numGroups * groupSize, 0);
+    oldSlots.swap(slots);
+    for (auto packed : oldSlots)
+        if (packed != 0)
+            slots[findSlot(slots, packed)] = packed;
+    frozen = false;
+}
+
+void AliasPairSet::thaw() {
+    if (frozen)
+        reserve(numPairs + 1);
+}
+
+bool AliasPairSet::insertPacked(std::uint64_t packed) {
+    thaw();
+    // Keep the table at most 7/8 full, so that probe sequences stay short
+    if ((numPairs + 1) * 8 > slots.size() * 7)
+        reserve(std::max<std::size_t>(numPairs * 2, groupSize - 1));
+
+    auto& slot = slots[findSlot(slots, packed)];
+    if (slot == packed)
+        return false;
+    slot = packed;
+    ++numPairs;
+    return true;
+}
+
+void AliasPairSet::insert(const AliasPairSet& other) {
+    reserve(numPairs + other.numPairs);
+    for (auto packed : other.slots)
+        if (packed != 0)
+            insertPacked(packed);
+}
+
+void AliasPairSet::insertSorted(const std::uint64_t* begin,
+                                const std::uint64_t* end) {
+    freeze();
+    std::vector<std::uint64_t> merged;
+    merged.reserve(slots.size() + (end - begin));
+    std::set_union(slots.begin(), slots.end(), begin, end,
+                   std::back_inserter(merged));
+    slots.swap(merged);
+    numPairs = slots.size();
+}
+
+bool AliasPairSet::count(const AliasPair& pair) const {
+    auto packed = packPair(pair);
+    if (frozen)
+        return std::binary_search(slots.begin(), slots.end(), packed);
+    if (slots.empty())
+        return false;
+    return slots[findSlot(slots, packed)] == packed;
+}
+
+void AliasPairSet::reserve(std::size_t n) {
+    if (n == 0 && !frozen)
+        return;
+    std::size_t numGroups = 1;
+    while (numGroups * groupSize * 7 < n * 8)
+        numGroups *= 2;
+    if (frozen || numGroups * groupSize > slots.size())
+        rehash(numGroups);
+}
+
+void AliasPairSet::freeze() {
+    if (frozen)
+        return;
+    std::vector<std::uint64_t> sorted;
+    sorted.reserve(numPairs);
+    for (auto packed : slots)
+        if (packed != 0)
+            sorted.push_back(packed);
+    std::sort(sorted.begin(), sorted.end());
+    slots.swap(sorted);
+    frozen = true;
+}
+
+void AliasPairSet::clear() {
+    slots = std::vector<std::uint64_t>();
+    numPairs = 0;
+    frozen = false;
+}
+}
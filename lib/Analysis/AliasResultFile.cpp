@@ -0,0 +1,328 @@
+#include "Dynamic/Analysis/AliasResultFile.h"
+#include "Dynamic/Analysis/DynamicAliasAnalysis.h"
+#include "Dynamic/Support/ThreadPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <string>
+
+namespace dynamic {
+
+namespace {
+
+const char resultFileMagic[8] = {'N', 'G', 'A', 'A', 'R', 'S', 'L', 'T'};
+constexpr std::uint32_t resultFileVersion = 1;
+
+struct ResultFileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t numFunctions;
+    std::uint64_t numPairs;
+};
+
+// Read and check the header and the function table of the result file
+// fileName from is
+ResultFileHeader
+readHeader(std::istream& is, const char* fileName,
+           std::vector<AliasResultFile::FunctionEntry>& functions) {
+    ResultFileHeader header;
+    is.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!is.good() ||
+        std::memcmp(header.magic, resultFileMagic, sizeof(resultFileMagic)) !=
+            0 ||
+        header.version != resultFileVersion)
+        throw std::runtime_error(std::string(fileName) +
+                                 " is not an alias result file of version " +
+                                 std::to_string(resultFileVersion));
+
+    functions.resize(header.numFunctions);
+    is.read(reinterpret_cast<char*>(functions.data()),
+            header.numFunctions * sizeof(AliasResultFile::FunctionEntry));
+    if (!is.good())
+        throw std::runtime_error(std::string("Alias result file ") + fileName +
+                                 " is truncated");
+
+    for (auto const& entry : functions) {
+        if (entry.firstPair > header.numPairs ||
+            entry.numPairs > header.numPairs - entry.firstPair)
+            throw std::runtime_error(std::string("Alias result file ") +
+                                     fileName + " is corrupted");
+    }
+    return header;
+}
+
+// The inputs that have pairs for one function of the merged result
+struct MergeItem
+{
+    DynamicPointer func;
+    std::vector<std::pair<const std::uint64_t*, const std::uint64_t*>> ranges;
+};
+
+void mergeRanges(const MergeItem& item, std::vector<std::uint64_t>& out) {
+    out.clear();
+    if (item.ranges.size() == 1) {
+        out.assign(item.ranges[0].first, item.ranges[0].second);
+        return;
+    }
+
+    // Heap of (next pair, input) with the smallest pair on top
+    using HeapEntry = std::pair<std::uint64_t, unsigned>;
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>,
+                        std::greater<HeapEntry>>
+        heap;
+    auto ranges = item.ranges;
+    for (auto i = 0u; i < ranges.size(); ++i) {
+        if (ranges[i].first != ranges[i].second)
+            heap.emplace(*ranges[i].first++, i);
+    }
+
+    while (!heap.empty()) {
+        auto top = heap.top();
+        heap.pop();
+        if (out.empty() || out.back() != top.first)
+            out.push_back(top.first);
+
+        auto& range = ranges[top.second];
+        if (range.first != range.second)
+            heap.emplace(*range.first++, top.second);
+    }
+}
+
+// Below this number of pairs per task, the merge is not worth splitting up
+constexpr std::uint64_t minPairsPerTask = 1 << 16;
+}
+
+AliasResultFile
+AliasResultFile::fromAnalysis(const DynamicAliasAnalysis& dynAA) {
+    std::vector<DynamicPointer> funcs;
+    for (auto const& mapping : dynAA) {
+        if (!mapping.second.empty())
+            funcs.push_back(mapping.first);
+    }
+    std::sort(funcs.begin(), funcs.end());
+
+    AliasResultFile result;
+    for (auto func : funcs) {
+        auto aliasPairs = dynAA.getAliasPairs(func);
+        auto firstPair = result.pairs.size();
+        for (auto itr = aliasPairs->begin(), ite = aliasPairs->end();
+             itr != ite; ++itr)
+            result.pairs.push_back(itr.getPacked());
+        if (!aliasPairs->isFrozen())
+            std::sort(result.pairs.begin() + firstPair, result.pairs.end());
+        result.functions.push_back(
+            FunctionEntry{func, 0, firstPair, aliasPairs->size()});
+    }
+    return result;
+}
+
+AliasResultFile
+AliasResultFile::merge(const std::vector<const AliasResultFile*>& inputs,
+                       unsigned numThreads) {
+    // Line up the inputs by function
+    std::vector<std::pair<DynamicPointer, unsigned>> funcInputs;
+    for (auto i = 0u; i < inputs.size(); ++i)
+        for (auto const& entry : inputs[i]->functions)
+            funcInputs.emplace_back(entry.id, i);
+    std::sort(funcInputs.begin(), funcInputs.end());
+
+    std::vector<MergeItem> items;
+    std::uint64_t totalPairs = 0;
+    for (auto const& funcInput : funcInputs) {
+        if (items.empty() || items.back().func != funcInput.first)
+            items.push_back(MergeItem{funcInput.first, {}});
+        auto range = inputs[funcInput.second]->getAliasPairs(funcInput.first);
+        items.back().ranges.push_back(range);
+        totalPairs += range.second - range.first;
+    }
+
+    // Each task merges a run of functions with about the same number of pairs
+    // in total
+    std::vector<std::vector<std::uint64_t>> merged(items.size());
+    auto mergeItems = [&items, &merged](std::size_t begin, std::size_t end) {
+        for (auto i = begin; i < end; ++i)
+            mergeRanges(items[i], merged[i]);
+    };
+    if (numThreads <= 1)
+        mergeItems(0, items.size());
+    else {
+        auto pairsPerTask =
+            std::max(totalPairs / (numThreads * 4) + 1, minPairsPerTask);
+        ThreadPool pool(numThreads, numThreads * 4);
+        std::size_t taskBegin = 0;
+        std::uint64_t taskPairs = 0;
+        for (std::size_t i = 0; i < items.size(); ++i) {
+            for (auto const& range : items[i].ranges)
+                taskPairs += range.second - range.first;
+            if (taskPairs >= pairsPerTask || i + 1 == items.size()) {
+                pool.submit(
+                    [&mergeItems, taskBegin, i] { mergeItems(taskBegin, i + 1); });
+                taskBegin = i + 1;
+                taskPairs = 0;
+            }
+        }
+        pool.wait();
+    }
+
+    AliasResultFile result;
+    std::uint64_t numPairs = 0;
+    for (auto const& vec : merged)
+        numPairs += vec.size();
+    result.pairs.reserve(numPairs);
+    result.functions.reserve(items.size());
+    for (std::size_t i = 0; i < items.size(); ++i) {
+        result.functions.push_back(FunctionEntry{
+            items[i].func, 0, result.pairs.size(), merged[i].size()});
+        result.pairs.insert(result.pairs.end(), merged[i].begin(),
+                            merged[i].end());
+        merged[i] = std::vector<std::uint64_t>();
+    }
+    return result;
+}
+
+bool AliasResultFile::isResultFile(const char* fileName) {
+    std::ifstream ifs(fileName, std::ios::in | std::ios::binary);
+    char magic[sizeof(resultFileMagic)];
+    ifs.read(magic, sizeof(magic));
+    return ifs.good() &&
+           std::memcmp(magic, resultFileMagic, sizeof(magic)) == 0;
+}
+
+AliasResultFile AliasResultFile::readFromFile(const char* fileName) {
+    std::ifstream ifs(fileName, std::ios::in | std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error(std::string("Cannot open alias result file ") +
+                                 fileName);
+
+    AliasResultFile result;
+    auto header = readHeader(ifs, fileName, result.functions);
+    result.pairs.resize(header.numPairs);
+    ifs.read(reinterpret_cast<char*>(result.pairs.data()),
+             header.numPairs * sizeof(std::uint64_t));
+    if (!ifs.good())
+        throw std::runtime_error(std::string("Alias result file ") + fileName +
+                                 " is truncated");
+    return result;
+}
+
+void AliasResultFile::writeToFile(const char* fileName) const {
+    std::ofstream ofs(fileName,
+                      std::ios::out | std::ios::binary | std::ios::trunc);
+
+    ResultFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, resultFileMagic, sizeof(header.magic));
+    header.version = resultFileVersion;
+    header.numFunctions = functions.size();
+    header.numPairs = pairs.size();
+
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(functions.data()),
+              functions.size() * sizeof(FunctionEntry));
+    ofs.write(reinterpret_cast<const char*>(pairs.data()),
+              pairs.size() * sizeof(std::uint64_t));
+    if (!ofs.good())
+        throw std::runtime_error(std::string("Cannot write alias result file ") +
+                                 fileName);
+}
+
+void AliasResultFile::writePairSets(
+    const char* fileName,
+    const std::vector<std::pair<DynamicPointer, const AliasPairSet*>>& sets) {
+    std::ofstream ofs(fileName,
+                      std::ios::out | std::ios::binary | std::ios::trunc);
+
+    std::vector<FunctionEntry> functions;
+    std::uint64_t numPairs = 0;
+    for (auto const& set : sets) {
+        if (!set.second->isFrozen())
+            throw std::logic_error("Only frozen pair sets can be written");
+        if (set.second->empty())
+            continue;
+        if (!functions.empty() && functions.back().id >= set.first)
+            throw std::logic_error("Pair sets are not sorted by function");
+        functions.push_back(
+            FunctionEntry{set.first, 0, numPairs, set.second->size()});
+        numPairs += set.second->size();
+    }
+
+    ResultFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, resultFileMagic, sizeof(header.magic));
+    header.version = resultFileVersion;
+    header.numFunctions = functions.size();
+    header.numPairs = numPairs;
+
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(functions.data()),
+              functions.size() * sizeof(FunctionEntry));
+    // A frozen set iterates over its sorted, packed pairs
+    for (auto const& set : sets)
+        for (auto itr = set.second->begin(), ite = set.second->end();
+             itr != ite; ++itr) {
+            auto packed = itr.getPacked();
+            ofs.write(reinterpret_cast<const char*>(&packed), sizeof(packed));
+        }
+    if (!ofs.good())
+        throw std::runtime_error(std::string("Cannot write alias result file ") +
+                                 fileName);
+}
+
+void AliasResultFile::writeAnalysis(const char* fileName,
+                                    const DynamicAliasAnalysis& dynAA) {
+    std::vector<std::pair<DynamicPointer, const AliasPairSet*>> sets;
+    for (auto const& mapping : dynAA)
+        sets.emplace_back(mapping.first, &mapping.second);
+    std::sort(sets.begin(), sets.end());
+    writePairSets(fileName, sets);
+}
+
+std::pair<const std::uint64_t*, const std::uint64_t*>
+AliasResultFile::getAliasPairs(DynamicPointer func) const {
+    auto itr = std::lower_bound(
+        functions.begin(), functions.end(), func,
+        [](const FunctionEntry& entry, DynamicPointer id) {
+            return entry.id < id;
+        });
+    if (itr == functions.end() || itr->id != func)
+        return std::make_pair(nullptr, nullptr);
+
+    auto begin = pairs.data() + itr->firstPair;
+    return std::make_pair(begin, begin + itr->numPairs);
+}
+
+std::vector<AliasPair>
+AliasResultFile::getUnpackedAliasPairs(DynamicPointer func) const {
+    std::vector<AliasPair> ret;
+    auto range = getAliasPairs(func);
+    for (auto itr = range.first; itr != range.second; ++itr)
+        ret.push_back(unpackPair(*itr));
+    return ret;
+}
+
+AliasResultFileReader::AliasResultFileReader(const char* name)
+    : fileName(name), ifs(name, std::ios::in | std::ios::binary) {
+    if (!ifs.is_open())
+        throw std::runtime_error("Cannot open alias result file " + fileName);
+    readHeader(ifs, name, functions);
+    pairsOffset = ifs.tellg();
+}
+
+void AliasResultFileReader::readAliasPairs(
+    const AliasResultFile::FunctionEntry& entry,
+    std::vector<std::uint64_t>& pairs) {
+    pairs.resize(entry.numPairs);
+    ifs.seekg(pairsOffset + entry.firstPair * sizeof(std::uint64_t));
+    ifs.read(reinterpret_cast<char*>(pairs.data()),
+             entry.numPairs * sizeof(std::uint64_t));
+    if (!ifs.good())
+        throw std::runtime_error("Alias result file " + fileName +
+                                 " is truncated");
+}
+}
@@ -0,0 +1,130 @@
+#include "Dynamic/Analysis/AllocationIndex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+namespace dynamic {
+
+namespace {
+
+using Allocation = AllocationIndex::Allocation;
+
+std::vector<Allocation> makeBlock() {
+    std::vector<Allocation> block;
+    // A block overflows by one before it is split
+    block.reserve(AllocationIndex::blockSize + 1);
+    return block;
+}
+}
+
+// Index of the last block that starts at or before addr, or 0 if there is
+// none
+std::size_t AllocationIndex::findBlock(std::uintptr_t addr) const {
+    auto itr = std::upper_bound(blockBegins.begin(), blockBegins.end(), addr);
+    return itr == blockBegins.begin() ? 0 : itr - blockBegins.begin() - 1;
+}
+
+void AllocationIndex::append(const Allocation& alloc) {
+    if (blocks.empty() || blocks.back().size() >= blockSize) {
+        blocks.push_back(makeBlock());
+        blockBegins.push_back(alloc.begin);
+    }
+    blocks.back().push_back(alloc);
+    ++numAllocations;
+}
+
+void AllocationIndex::eraseOverlapping(const Allocation& alloc) {
+    // The allocations are disjoint, so their ends are sorted just like their
+    // beginnings, and the ones overlapping alloc form a single run
+    auto b = findBlock(alloc.begin);
+    while (b < blocks.size()) {
+        auto& block = blocks[b];
+        auto first = std::upper_bound(
+            block.begin(), block.end(), alloc.begin,
+            [](std::uintptr_t addr, const Allocation& a) {
+                return addr < a.end;
+            });
+        auto last = std::lower_bound(
+            first, block.end(), alloc.end,
+            [](const Allocation& a, std::uintptr_t addr) {
+                return a.begin < addr;
+            });
+        auto runContinues = last == block.end();
+        numAllocations -= last - first;
+        block.erase(first, last);
+
+        if (block.empty()) {
+            blocks.erase(blocks.begin() + b);
+            blockBegins.erase(blockBegins.begin() + b);
+        } else {
+            blockBegins[b] = block.front().begin;
+            ++b;
+        }
+        if (!runContinues)
+            break;
+    }
+}
+
+void AllocationIndex::insert(const void* addr, std::size_t size) {
+    assert(size != 0 && "Allocation of unknown size");
+    auto begin = reinterpret_cast<std::uintptr_t>(addr);
+    auto end = begin + size;
+    if (end < begin)
+        end = std::numeric_limits<std::uintptr_t>::max();
+    Allocation alloc{begin, end};
+    lastFound = Allocation{0, 0};
+
+    if (!blocks.empty() && begin < blocks.back().back().end)
+        eraseOverlapping(alloc);
+    if (blocks.empty() || begin >= blocks.back().back().end) {
+        append(alloc);
+        return;
+    }
+
+    auto b = findBlock(begin);
+    auto& block = blocks[b];
+    auto pos = std::upper_bound(block.begin(), block.end(), begin,
+                                [](std::uintptr_t addr, const Allocation& a) {
+                                    return addr < a.begin;
+                                });
+    block.insert(pos, alloc);
+    blockBegins[b] = block.front().begin;
+    ++numAllocations;
+
+    if (block.size() > blockSize) {
+        auto upper = makeBlock();
+        auto mid = block.begin() + block.size() / 2;
+        upper.assign(mid, block.end());
+        block.erase(mid, block.end());
+        blockBegins.insert(blockBegins.begin() + b + 1, upper.front().begin);
+        blocks.insert(blocks.begin() + b + 1, std::move(upper));
+    }
+}
+
+const Allocation* AllocationIndex::find(const void* addr) const {
+    auto a = reinterpret_cast<std::uintptr_t>(addr);
+    if (blocks.empty() || a < blockBegins.front())
+        return nullptr;
+
+    auto const& block = blocks[findBlock(a)];
+    auto pos = std::upper_bound(
+        block.begin(), block.end(), a,
+        [](std::uintptr_t addr, const Allocation& alloc) {
+            return addr < alloc.begin;
+        });
+    // The block starts at or before a, so pos is not its first allocation
+    --pos;
+    if (a >= pos->end)
+        return nullptr;
+    lastFound = *pos;
+    return &*pos;
+}
+
+void AllocationIndex::clear() {
+    blocks = std::vector<std::vector<Allocation>>();
+    blockBegins = std::vector<std::uintptr_t>();
+    numAllocations = 0;
+    lastFound = Allocation{0, 0};
+}
+}
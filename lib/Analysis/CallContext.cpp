@@ -0,0 +1,125 @@
+#include "Dynamic/Analysis/CallContext.h"
+
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+namespace dynamic {
+
+CallContextTable::CallContextTable(unsigned d, std::size_t m)
+    : maxDepth(d), maxContexts(std::max<std::size_t>(m, 1)), numDegraded(0) {
+    nodes.push_back(Node{EmptyContext, 0, 0});
+}
+
+ContextID CallContextTable::intern(ContextID prefix, DynamicPointer callSite,
+                                   bool create) {
+    auto key = std::make_pair(prefix, callSite);
+    auto itr = nodeMap.find(key);
+    if (itr != nodeMap.end())
+        return itr->second;
+    if (!create || nodes.size() >= maxContexts)
+        return InvalidContext;
+
+    ContextID id = nodes.size();
+    nodes.push_back(Node{prefix, callSite, nodes[prefix].depth + 1});
+    nodeMap.insert(std::make_pair(key, id));
+    return id;
+}
+
+ContextID CallContextTable::keepRecent(ContextID ctx, unsigned depth,
+                                       bool create) {
+    // A copy, since interning may grow the table
+    auto node = nodes[ctx];
+    if (depth >= node.depth)
+        return ctx;
+    if (depth == 0)
+        return EmptyContext;
+
+    auto prefix = keepRecent(node.prefix, depth - 1, create);
+    if (prefix == InvalidContext)
+        return InvalidContext;
+    return intern(prefix, node.callSite, create);
+}
+
+ContextID CallContextTable::findRecent(ContextID ctx, unsigned depth) {
+    return keepRecent(ctx, depth, false);
+}
+
+ContextID CallContextTable::push(ContextID caller, DynamicPointer callSite) {
+    if (maxDepth == 0)
+        return EmptyContext;
+
+    auto key = std::make_pair(caller, callSite);
+    auto itr = pushCache.find(key);
+    if (itr != pushCache.end())
+        return itr->second;
+
+    // Try the full call string first, then ones with fewer of the caller's
+    // call sites
+    auto expectedDepth = std::min(nodes[caller].depth + 1, maxDepth);
+    auto ctx = InvalidContext;
+    for (auto depth = expectedDepth; depth > 0 && ctx == InvalidContext;
+         --depth) {
+        auto prefix = keepRecent(caller, depth - 1, true);
+        if (prefix != InvalidContext)
+            ctx = intern(prefix, callSite, true);
+    }
+    if (ctx == InvalidContext)
+        ctx = EmptyContext;
+    if (nodes[ctx].depth < expectedDepth)
+        ++numDegraded;
+
+    if (pushCache.size() >= nodes.size())
+        pushCache.clear();
+    pushCache.insert(std::make_pair(key, ctx));
+    return ctx;
+}
+
+std::vector<DynamicPointer>
+CallContextTable::getCallSites(ContextID ctx) const {
+    std::vector<DynamicPointer> ret;
+    for (; ctx != EmptyContext; ctx = nodes[ctx].prefix)
+        ret.push_back(nodes[ctx].callSite);
+    std::reverse(ret.begin(), ret.end());
+    return ret;
+}
+
+void CallContextTable::writeTo(std::ostream& os) const {
+    std::uint64_t numNodes = nodes.size();
+    os.write(reinterpret_cast<const char*>(&numNodes), sizeof(numNodes));
+    // The empty context is always there
+    for (auto itr = nodes.begin() + 1; itr != nodes.end(); ++itr) {
+        auto const& node = *itr;
+        os.write(reinterpret_cast<const char*>(&node.prefix),
+                 sizeof(node.prefix));
+        os.write(reinterpret_cast<const char*>(&node.callSite),
+                 sizeof(node.callSite));
+    }
+}
+
+// Contexts are numbered in order of creation, so reinserting them in order
+// gives them back their IDs
+void CallContextTable::readFrom(std::istream& is) {
+    std::uint64_t numNodes;
+    is.read(reinterpret_cast<char*>(&numNodes), sizeof(numNodes));
+    if (!is.good() || numNodes == 0)
+        throw std::runtime_error("Call context table is truncated");
+
+    nodes.resize(1);
+    nodeMap.clear();
+    pushCache.clear();
+    for (std::uint64_t i = 1; i < numNodes; ++i) {
+        Node node;
+        is.read(reinterpret_cast<char*>(&node.prefix), sizeof(node.prefix));
+        is.read(reinterpret_cast<char*>(&node.callSite),
+                sizeof(node.callSite));
+        if (!is.good() || node.prefix >= nodes.size())
+            throw std::runtime_error("Call context table is corrupted");
+        node.depth = nodes[node.prefix].depth + 1;
+        nodeMap.insert(
+            std::make_pair(std::make_pair(node.prefix, node.callSite), i));
+        nodes.push_back(node);
+    }
+}
+}
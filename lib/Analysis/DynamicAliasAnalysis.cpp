@@ -1,9 +1,32 @@
 #include "Dynamic/Analysis/DynamicAliasAnalysis.h"
-#include <llvm/ADT/SmallPtrSet.h>
+#include "Dynamic/Analysis/AliasResultFile.h"
+#include "Dynamic/Analysis/AllocationIndex.h"
+#include "Dynamic/Analysis/CallContext.h"
+#include "Dynamic/Analysis/PtsSet.h"
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallVector.h>
 #include "Dynamic/Instrument/AllocType.h"
+#include "Dynamic/Log/LogIndex.h"
 #include "Dynamic/Log/LogProcessor.h"
+#include "Dynamic/Support/ThreadPool.h"
 
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
 
 using namespace llvm;
 
@@ -11,106 +34,1577 @@ namespace dynamic {
 
 namespace {
 
+// The points-to sets of the local pointers of a frame, in order of appearance.
+// Clearing keeps the storage of the sets around, so that a recycled map
+// rarely needs to allocate.
+class LocalMap
+{
+private:
+    using Slot = std::pair<DynamicPointer, PtsSet>;
+    DenseMap<DynamicPointer, unsigned> slotIndex;
+    std::vector<Slot> slots;
+    unsigned numSlots = 0;
+
+public:
+    using const_iterator = std::vector<Slot>::const_iterator;
+
+    LocalMap() = default;
+    LocalMap(LocalMap&& other)
+        : slotIndex(std::move(other.slotIndex)), slots(std::move(other.slots)),
+          numSlots(other.numSlots) {
+        other.numSlots = 0;
+    }
+    LocalMap& operator=(LocalMap&& other) {
+        slotIndex = std::move(other.slotIndex);
+        slots = std::move(other.slots);
+        numSlots = other.numSlots;
+        other.numSlots = 0;
+        return *this;
+    }
+
+    PtsSet& operator[](DynamicPointer ptr) {
+        auto res = slotIndex.insert(std::make_pair(ptr, numSlots));
+        if (res.second) {
+            if (numSlots == slots.size())
+                slots.emplace_back();
+            slots[numSlots].first = ptr;
+            ++numSlots;
+        }
+        return slots[res.first->second].second;
+    }
+
+    void clear() {
+        slotIndex.clear();
+        for (auto i = 0u; i < numSlots; ++i)
+            slots[i].second.clear();
+        numSlots = 0;
+    }
+    // Sort the points-to sets, which only needs to be done once the frame
+    // has exited
+    void normalize() {
+        for (auto i = 0u; i < numSlots; ++i)
+            slots[i].second.normalize();
+    }
+
+    // Estimated number of bytes allocated, including storage kept for reuse
+    std::size_t getMemoryUsage() const;
+    std::size_t size() const { return numSlots; }
+    const_iterator begin() const { return slots.begin(); }
+    const_iterator end() const { return slots.begin() + numSlots; }
+};
+using GlobalAddrMap = DenseMap<const void*, SmallVector<DynamicPointer, 1>>;
+
+// Everything learned about a function over all its invocations so far, so that
+// pairs found once are not searched for again
+class FunctionSummary
+{
+private:
+    // Local pointers of the function, numbered densely in order of appearance
+    DenseMap<DynamicPointer, unsigned> localIndex;
+    std::vector<DynamicPointer> localPointers;
+
+    // The following are only maintained while the function has at most
+    // maxTrackedPointers local pointers. Bit j * (j - 1) / 2 + i is set iff
+    // local pointers i < j are known to alias, so that a new pointer only
+    // appends a row of bits.
+    bool tracked = true;
+    std::vector<std::uint64_t> pairBits;
+    std::vector<unsigned> numPartners;
+    std::uint64_t numPairs = 0;
+
+    // Collects the pairs new to the summary while a frame is added, if set
+    std::vector<AliasPair>* newPairs = nullptr;
+
+    using FramePointers = std::vector<std::pair<unsigned, const PtsSet*>>;
+    void insertPair(const AliasPair&);
+    void addLocalPair(unsigned, unsigned);
+    void findLocalPairsPairwise(const FramePointers&);
+    void findLocalPairsIndexed(const FramePointers&);
+    void findGlobalPairs(const LocalMap&, const GlobalAddrMap&);
+
+public:
+    // Held while a frame of the function is searched, since frames of the same
+    // function may be handed to different worker threads
+    std::mutex mutex;
+    AliasPairSet pairs;
+
+    // Normalizes the local map of the frame. The pairs the frame adds to the
+    // summary are appended to newPairs unless it is null.
+    void addFrame(LocalMap&, const GlobalAddrMap&,
+                  std::vector<AliasPair>* newPairs = nullptr);
+    // Estimated number of bytes allocated by the summary
+    std::size_t getMemoryUsage() const;
+
+    void writeTo(std::ostream&) const;
+    void readFrom(std::istream&);
+};
+
+// The part of a frame seen by one shard of the log. The frame is identified by
+// the offset of its EnterRecord.
+struct PartialFrame
+{
+    std::uint64_t enterOffset;
+    DynamicPointer func;
+    LocalMap localMap;
+};
+
 class AnalysisImpl : public LogProcessor<AnalysisImpl>
 {
 private:
-    using AliasPairSet = DenseSet<AliasPair>;
     using AnalysisMap = DenseMap<DynamicPointer, AliasPairSet>;
     AnalysisMap& aliasPairMap;
+    using ContextKey = std::pair<DynamicPointer, ContextID>;
+    using ContextAnalysisMap = DenseMap<ContextKey, AliasPairSet>;
+    ContextAnalysisMap& contextAliasPairMap;
+
+    CallContextTable& contexts;
+    // Beyond this many summaries, the summaries of new (function, context)
+    // pairs fall back to shorter contexts
+    std::size_t maxContextSummaries;
+    std::uint64_t numDegradedSummaries = 0;
 
     using GlobalMap = DenseMap<DynamicPointer, const void*>;
     GlobalMap globalMap;
+    // The reverse of globalMap, so that the globals at an address can be
+    // found without scanning all of them. Frames queued for the workers hold
+    // on to the version current at their exit, so it is copied before being
+    // modified while shared.
+    std::shared_ptr<GlobalAddrMap> globalAddrMap;
+
+    // With object granularity, pointers into an allocation of known size are
+    // taken to point to its start, so that they alias whenever they point
+    // into the same object
+    bool objectGranularity = false;
+    AllocationIndex allocations;
+
+    DynamicAliasAnalysis::PairListener pairListener;
 
-    using PtsSet = SmallPtrSet<const void*, 4>;
-    using LocalMap = DenseMap<DynamicPointer, PtsSet>;
     struct Frame
     {
         DynamicPointer func;
+        ContextID context;
+        LocalMap localMap;
+        // Set for frames entered before the shard being analyzed, which are
+        // saved as partial frames on exit instead of being searched
+        bool partial;
+        std::uint64_t enterOffset;
+        // Set while the local map is spilled to the spill file of its thread,
+        // where it takes up spillSize bytes from spillOffset on
+        bool spilled;
+        std::uint64_t spillOffset;
+        std::uint64_t spillSize;
+    };
+    struct ThreadStack
+    {
+        // Frames are not destroyed on exit but reused by the next frame
+        // entered at the same depth, together with the storage of their local
+        // maps
+        std::vector<Frame> frames;
+        std::size_t depth = 0;
+        // The call site of the last CallRecord of the thread, until the callee
+        // is entered
+        DynamicPointer pendingCall = 0;
+        // Local maps of frames deep in the stack, in stack order, so that the
+        // file always ends with the next frame to be read back
+        std::fstream spillFile;
+        std::uint64_t spillEnd = 0;
+    };
+    // Each thread nests its frames on a stack of its own, while the globals
+    // are shared by all of them. The stacks are kept in a std::map so that the
+    // current one stays in place while the stacks of new threads are added.
+    std::map<unsigned, ThreadStack> threadStacks;
+    unsigned currentThread = 0;
+    ThreadStack* stack;
+    std::vector<PartialFrame>* partialFrames = nullptr;
+
+    // Summaries are only ever inserted by the analysis thread. They are
+    // allocated separately so that a worker can keep using one while the map
+    // grows.
+    DenseMap<ContextKey, std::unique_ptr<FunctionSummary>> summaries;
+
+    // Completed frames are handed to the workers in batches, so that small
+    // frames do not drown in the cost of queueing them
+    struct QueuedFrame
+    {
+        DynamicPointer func;
+        FunctionSummary* summary;
         LocalMap localMap;
+        std::shared_ptr<const GlobalAddrMap> globals;
     };
-    std::vector<Frame> stackFrames;
+    std::vector<QueuedFrame> frameBatch;
+    std::size_t frameBatchSize = 0;
+    // Local maps the workers are done with, to be swapped into the stack in
+    // place of the ones queued
+    std::mutex freeLocalMapsMutex;
+    std::vector<LocalMap> freeLocalMaps;
+
+    // Zero if the memory of the analysis is not bounded
+    std::size_t memoryBudget = 0;
+    // Files spilled to disk are named after this prefix
+    std::string spillPrefix;
+    // Alias pairs moved out of the summaries, in alias result files
+    std::vector<std::string> spilledRuns;
+    std::uint64_t numSpilledRuns = 0;
+    std::uint64_t numSpilledFrames = 0;
+
+    // Destroyed first, so that no worker outlives the state it refers to
+    std::unique_ptr<ThreadPool> pool;
+
+    void submitFrameBatch();
+    // Search a completed frame of func and pass the pairs it adds to the
+    // listener. Locks the summary if workers may share it.
+    void searchFrame(DynamicPointer func, FunctionSummary&, LocalMap&,
+                     const GlobalAddrMap&);
+    Frame& currentFrame() { return stack->frames[stack->depth - 1]; }
+    void popFrame();
+    void switchThread(unsigned thread) {
+        currentThread = thread;
+        stack = &threadStacks[thread];
+    }
 
-    static bool intersects(const PtsSet&, const PtsSet&);
-    void findAliasPairs();
+    GlobalAddrMap& getGlobalAddrMapForUpdate();
+    FunctionSummary& getSummary(DynamicPointer func, ContextID ctx);
+    // Wait for the frames exited so far to be searched
+    void drainWorkers();
+    std::uint64_t hashLogBefore(std::size_t logOffset) const;
+
+    std::size_t getMemoryUsage() const;
+    void spillSummaries();
+    void spillColdFrames(unsigned thread, ThreadStack&);
+    void unspillFrame(ThreadStack&, Frame&);
+    void removeSpilledFrames(unsigned thread, ThreadStack&);
+    std::string getSpilledRunName(std::size_t index) const {
+        return spillPrefix + ".run" + std::to_string(index) + ".res";
+    }
+    std::string getSpilledFramesName(unsigned thread) const {
+        return spillPrefix + ".frames" + std::to_string(thread);
+    }
 
 public:
-    AnalysisImpl(const char* fileName, AnalysisMap& m)
-        : LogProcessor<AnalysisImpl>(fileName), aliasPairMap(m) {}
+    AnalysisImpl(const char* fileName, AnalysisMap& m, ContextAnalysisMap& cm,
+                 CallContextTable& contexts, std::size_t maxContextSummaries,
+                 unsigned numWorkers = 1);
+    ~AnalysisImpl();
+
+    std::uint64_t getNumDegradedSummaries() const {
+        return numDegradedSummaries;
+    }
+    std::uint64_t getNumSpilledRuns() const { return numSpilledRuns; }
+    std::uint64_t getNumSpilledFrames() const { return numSpilledFrames; }
+
+    void setObjectGranularity(bool enabled) { objectGranularity = enabled; }
+    void setPairListener(const DynamicAliasAnalysis::PairListener& listener) {
+        pairListener = listener;
+    }
+
+    // Files spilled to disk, including the ones restored from a checkpoint,
+    // are named after spillPrefix. If budget is non-zero, the analysis spills
+    // once its estimated memory use exceeds budget bytes.
+    void setMemoryBudget(std::size_t budget, const std::string& spillPrefix);
+    bool hasMemoryBudget() const { return memoryBudget != 0; }
+    // Called between two chunks of the log, with the offset the next chunk
+    // starts at
+    void enforceMemoryBudget(std::size_t logOffset);
+
+    // Wait for the frames still being searched and move the summaries out
+    void finish();
+
+    // Save the state of the analysis after the records before logOffset have
+    // been visited. The file is replaced atomically.
+    void writeCheckpoint(const char* fileName, std::size_t logOffset);
+    // Restore the state saved by writeCheckpoint() and return the log offset
+    // to continue from
+    std::size_t readCheckpoint(const char* fileName);
+
+    // Visit the shard [beginOffset, endOffset) of the log, after the globals
+    // allocated before it. Frames open at either end of the shard are added to
+    // partialFrames instead of being searched.
+    void processShard(const LogIndex&, std::uint64_t beginOffset,
+                      std::uint64_t endOffset,
+                      std::vector<PartialFrame>& partialFrames);
+    // Search the partial frames that have been put together from all shards,
+    // with the globals allocated before their exit
+    void searchPartialFrames(const LogIndex&, std::vector<PartialFrame>&);
 
     void visitAllocRecord(const AllocRecord& allocRecord);
-    void visitPointerRecord(const PointerRecord&);
+    void visitPointerRecords(const LogRecord* begin, const LogRecord* end);
     void visitEnterRecord(const EnterRecord&);
     void visitExitRecord(const ExitRecord&);
     void visitCallRecord(const CallRecord&);
+    void visitThreadRecord(const ThreadRecord&);
 };
 
-bool AnalysisImpl::intersects(const PtsSet& lhs, const PtsSet& rhs) {
-    for (auto ptr : lhs) {
-        if (rhs.count(ptr))
-            return true;
+std::size_t LocalMap::getMemoryUsage() const {
+    auto usage = slotIndex.getMemorySize() + slots.capacity() * sizeof(Slot);
+    for (auto const& slot : slots)
+        usage += slot.second.getMemoryUsage();
+    return usage;
+}
+
+std::size_t FunctionSummary::getMemoryUsage() const {
+    return sizeof(FunctionSummary) + localIndex.getMemorySize() +
+           localPointers.capacity() * sizeof(DynamicPointer) +
+           pairBits.capacity() * sizeof(std::uint64_t) +
+           numPartners.capacity() * sizeof(unsigned) + pairs.getMemoryUsage();
+}
+
+// Below this number of pointers, comparing every pair of points-to sets is
+// cheaper than building an address index
+constexpr unsigned pairwiseFrameSize = 8;
+// Functions with more local pointers than this only rely on their summaries
+// to weed out known pairs, since the pair bitmap would get too large
+constexpr unsigned maxTrackedPointers = 4096;
+
+// Scratch space of FunctionSummary::addFrame(), kept around per thread to
+// avoid reallocation
+thread_local std::vector<std::pair<unsigned, const PtsSet*>> framePointers;
+thread_local std::vector<std::pair<const void*, unsigned>> addrIndex;
+// Pairs found in the frame being searched, for the pair listener
+thread_local std::vector<AliasPair> framePairs;
+
+void FunctionSummary::insertPair(const AliasPair& pair) {
+    if (pairs.insert(pair) && newPairs != nullptr)
+        newPairs->push_back(pair);
+}
+
+void FunctionSummary::addLocalPair(unsigned i, unsigned j) {
+    if (tracked) {
+        if (i > j)
+            std::swap(i, j);
+        auto bit = std::uint64_t(j) * (j - 1) / 2 + i;
+        auto& word = pairBits[bit / 64];
+        auto mask = std::uint64_t(1) << (bit % 64);
+        if (word & mask)
+            return;
+        word |= mask;
+        ++numPartners[i];
+        ++numPartners[j];
+        ++numPairs;
+    }
+    insertPair(AliasPair(localPointers[i], localPointers[j]));
+}
+
+void FunctionSummary::findLocalPairsPairwise(const FramePointers& ptrs) {
+    for (auto itr = ptrs.begin(), ite = ptrs.end(); itr != ite; ++itr) {
+        for (auto itr2 = itr + 1; itr2 != ite; ++itr2) {
+            if (itr->second->intersects(*itr2->second))
+                addLocalPair(itr->first, itr2->first);
+        }
+    }
+}
+
+// Sort all (address, pointer) pairs of the frame by address. Two pointers
+// alias iff they show up in the same address bucket, so only pointers within
+// a bucket need to be paired up.
+void FunctionSummary::findLocalPairsIndexed(const FramePointers& ptrs) {
+    addrIndex.clear();
+    for (auto const& ptr : ptrs)
+        for (auto addr : *ptr.second)
+            addrIndex.emplace_back(addr, ptr.first);
+    std::sort(addrIndex.begin(), addrIndex.end());
+
+    for (auto bucketBegin = addrIndex.begin(), ite = addrIndex.end();
+         bucketBegin != ite;) {
+        auto bucketEnd = bucketBegin + 1;
+        while (bucketEnd != ite && bucketEnd->first == bucketBegin->first)
+            ++bucketEnd;
+
+        for (auto itr = bucketBegin; itr != bucketEnd; ++itr)
+            for (auto itr2 = itr + 1; itr2 != bucketEnd; ++itr2)
+                addLocalPair(itr->second, itr2->second);
+
+        bucketBegin = bucketEnd;
+    }
+}
+
+void FunctionSummary::findGlobalPairs(const LocalMap& localMap,
+                                      const GlobalAddrMap& globalAddrMap) {
+    if (globalAddrMap.empty())
+        return;
+
+    for (auto const& mapping : localMap) {
+        for (auto addr : mapping.second) {
+            auto itr = globalAddrMap.find(addr);
+            if (itr == globalAddrMap.end())
+                continue;
+            for (auto global : itr->second)
+                insertPair(AliasPair(mapping.first, global));
+        }
+    }
+}
+
+void FunctionSummary::addFrame(LocalMap& localMap,
+                               const GlobalAddrMap& globalAddrMap,
+                               std::vector<AliasPair>* pairSink) {
+    newPairs = pairSink;
+    localMap.normalize();
+    framePointers.clear();
+    auto numPointers = localPointers.size();
+    for (auto const& mapping : localMap) {
+        auto res = localIndex.insert(
+            std::make_pair(mapping.first, localPointers.size()));
+        if (res.second)
+            localPointers.push_back(mapping.first);
+        framePointers.emplace_back(res.first->second, &mapping.second);
+    }
+    bool hasNewPointers = localPointers.size() != numPointers;
+    numPointers = localPointers.size();
+
+    if (hasNewPointers && tracked) {
+        if (numPointers > maxTrackedPointers) {
+            tracked = false;
+            pairBits = std::vector<std::uint64_t>();
+            numPartners = std::vector<unsigned>();
+        } else {
+            auto numBits = std::uint64_t(numPointers) * (numPointers - 1) / 2;
+            pairBits.resize((numBits + 63) / 64);
+            numPartners.resize(numPointers);
+        }
+    }
+
+    // Once every pair of local pointers is known to alias, the function has
+    // nothing left to learn about them until a new pointer shows up
+    auto saturated =
+        tracked && !hasNewPointers &&
+        numPairs == std::uint64_t(numPointers) * (numPointers - 1) / 2;
+    if (!saturated) {
+        // Neither can a pointer known to alias every other local pointer
+        if (tracked)
+            framePointers.erase(
+                std::remove_if(framePointers.begin(), framePointers.end(),
+                               [&](const std::pair<unsigned, const PtsSet*>& p) {
+                                   return numPartners[p.first] + 1 ==
+                                          numPointers;
+                               }),
+                framePointers.end());
+
+        if (framePointers.size() <= pairwiseFrameSize)
+            findLocalPairsPairwise(framePointers);
+        else
+            findLocalPairsIndexed(framePointers);
+    }
+
+    findGlobalPairs(localMap, globalAddrMap);
+    newPairs = nullptr;
+}
+
+// A batch of frames is submitted once it holds this many pointers
+constexpr std::size_t frameBatchPointers = 1024;
+// Queued frames are small compared to the summaries, but there is no point in
+// decoding far ahead of the workers either
+constexpr std::size_t maxQueuedBatchesPerWorker = 16;
+
+AnalysisImpl::AnalysisImpl(const char* fileName, AnalysisMap& m,
+                           ContextAnalysisMap& cm, CallContextTable& c,
+                           std::size_t maxSummaries, unsigned numWorkers)
+    : LogProcessor<AnalysisImpl>(fileName), aliasPairMap(m),
+      contextAliasPairMap(cm), contexts(c), maxContextSummaries(maxSummaries),
+      globalAddrMap(std::make_shared<GlobalAddrMap>()) {
+    switchThread(0);
+    if (numWorkers > 1)
+        pool.reset(new ThreadPool(numWorkers,
+                                  numWorkers * maxQueuedBatchesPerWorker));
+}
+
+AnalysisImpl::~AnalysisImpl() {
+    for (auto const& run : spilledRuns)
+        std::remove(run.data());
+    for (auto& mapping : threadStacks)
+        removeSpilledFrames(mapping.first, mapping.second);
+}
+
+GlobalAddrMap& AnalysisImpl::getGlobalAddrMapForUpdate() {
+    // Only the analysis thread copies the pointer, so a use count of one
+    // cannot go up behind our back
+    if (globalAddrMap.use_count() > 1) {
+        globalAddrMap = std::make_shared<GlobalAddrMap>(*globalAddrMap);
+    } else {
+        // use_count() is a relaxed load. The fence pairs with the release of
+        // the last worker's copy, so that its reads of the map happen before
+        // the map is modified.
+        std::atomic_thread_fence(std::memory_order_acquire);
     }
-    return false;
+    return *globalAddrMap;
 }
 
-void AnalysisImpl::findAliasPairs() {
-    auto func = stackFrames.back().func;
-    auto& summary = aliasPairMap[func];
-    auto const& localMap = stackFrames.back().localMap;
+FunctionSummary& AnalysisImpl::getSummary(DynamicPointer func,
+                                          ContextID ctx) {
+    auto itr = summaries.find(ContextKey(func, ctx));
+    if (itr != summaries.end())
+        return *itr->second;
 
-    for (auto itr = localMap.begin(), ite = localMap.end(); itr != ite; ++itr) {
-        auto itr2 = itr;
-        for (++itr2; itr2 != ite; ++itr2) {
-            if (intersects(itr->second, itr2->second))
-                summary.insert(AliasPair(itr->first, itr2->first));
+    // Out of room for more contexts of the function, so fall back to the
+    // longest recent part of the context it already has a summary for. The
+    // function without context is always allowed.
+    if (ctx != CallContextTable::EmptyContext &&
+        summaries.size() >= maxContextSummaries) {
+        ++numDegradedSummaries;
+        for (auto depth = contexts.getDepth(ctx); depth > 0; --depth) {
+            auto recent = contexts.findRecent(ctx, depth - 1);
+            if (recent == CallContextTable::InvalidContext)
+                continue;
+            itr = summaries.find(ContextKey(func, recent));
+            if (itr != summaries.end())
+                return *itr->second;
         }
+        ctx = CallContextTable::EmptyContext;
+    }
+
+    auto& summary = summaries[ContextKey(func, ctx)];
+    if (!summary)
+        summary.reset(new FunctionSummary());
+    return *summary;
+}
+
+// Frames of different functions are searched concurrently, frames of the same
+// function one after another
+void AnalysisImpl::submitFrameBatch() {
+    auto batch = std::make_shared<std::vector<QueuedFrame>>();
+    batch->swap(frameBatch);
+    frameBatchSize = 0;
+    pool->submit([this, batch] {
+        for (auto& frame : *batch) {
+            // Needs no lock, so it is done before taking one
+            frame.localMap.normalize();
+            searchFrame(frame.func, *frame.summary, frame.localMap,
+                        *frame.globals);
+            frame.localMap.clear();
+        }
+
+        std::lock_guard<std::mutex> lock(freeLocalMapsMutex);
+        for (auto& frame : *batch)
+            freeLocalMaps.push_back(std::move(frame.localMap));
+    });
+}
+
+void AnalysisImpl::searchFrame(DynamicPointer func, FunctionSummary& summary,
+                               LocalMap& localMap,
+                               const GlobalAddrMap& globals) {
+    framePairs.clear();
+    auto pairSink = pairListener ? &framePairs : nullptr;
+    if (pool) {
+        std::lock_guard<std::mutex> lock(summary.mutex);
+        summary.addFrame(localMap, globals, pairSink);
+    } else {
+        summary.addFrame(localMap, globals, pairSink);
     }
+    // Called without the lock, so that the listener may take its time
+    if (!framePairs.empty())
+        pairListener(func, framePairs);
+}
+
+void AnalysisImpl::drainWorkers() {
+    if (pool) {
+        if (!frameBatch.empty())
+            submitFrameBatch();
+        pool->wait();
+    }
+}
+
+void AnalysisImpl::finish() {
+    drainWorkers();
 
-    for (auto itr = localMap.begin(), ite = localMap.end(); itr != ite; ++itr) {
-        for (auto itr2 = globalMap.begin(), ite2 = globalMap.end();
-             itr2 != ite2; ++itr2) {
-            if (itr->second.count(itr2->second))
-                summary.insert(AliasPair(itr->first, itr2->first));
+    // The summaries of a function in all its contexts make up its summary
+    auto keepContexts = contexts.getMaxDepth() > 0;
+    for (auto& mapping : summaries) {
+        auto& summaryPairs = mapping.second->pairs;
+        auto& pairs = aliasPairMap[mapping.first.first];
+        if (keepContexts) {
+            pairs.insert(summaryPairs);
+            auto& contextPairs = contextAliasPairMap[mapping.first];
+            if (contextPairs.empty())
+                contextPairs = std::move(summaryPairs);
+            else
+                contextPairs.insert(summaryPairs);
+        } else if (pairs.empty())
+            pairs = std::move(summaryPairs);
+        else
+            pairs.insert(summaryPairs);
+    }
+    summaries.clear();
+
+    // Nothing is added to the results from here on, so they can be compacted
+    for (auto& mapping : aliasPairMap)
+        mapping.second.freeze();
+    for (auto& mapping : contextAliasPairMap)
+        mapping.second.freeze();
+
+    // Spilled pairs are read back one function at a time, so that no run has
+    // to fit in memory as a whole
+    std::vector<std::uint64_t> runPairs;
+    for (auto const& run : spilledRuns) {
+        AliasResultFileReader reader(run.data());
+        for (auto const& entry : reader.getFunctions()) {
+            reader.readAliasPairs(entry, runPairs);
+            aliasPairMap[entry.id].insertSorted(
+                runPairs.data(), runPairs.data() + runPairs.size());
         }
+        std::remove(run.data());
     }
+    spilledRuns.clear();
 }
 
 void AnalysisImpl::visitAllocRecord(const AllocRecord& allocRecord) {
+    if (objectGranularity && allocRecord.size != 0)
+        allocations.insert(allocRecord.address, allocRecord.size);
+
     if (allocRecord.type == AllocType::Global) {
-        globalMap[allocRecord.id] = allocRecord.address;
+        auto& globalAddr = globalMap[allocRecord.id];
+        if (globalAddr == allocRecord.address)
+            return;
+
+        // The global has moved, so it is no longer found at its old address
+        auto& addrMap = getGlobalAddrMapForUpdate();
+        if (globalAddr != nullptr) {
+            auto& oldGlobals = addrMap[globalAddr];
+            oldGlobals.erase(
+                std::find(oldGlobals.begin(), oldGlobals.end(), allocRecord.id));
+            if (oldGlobals.empty())
+                addrMap.erase(globalAddr);
+        }
+        globalAddr = allocRecord.address;
+        addrMap[globalAddr].push_back(allocRecord.id);
     } else {
-        stackFrames.back().localMap[allocRecord.id].insert(allocRecord.address);
+        currentFrame().localMap[allocRecord.id].insert(allocRecord.address);
     }
 }
 
-void AnalysisImpl::visitPointerRecord(const PointerRecord& ptrRecord) {
-    stackFrames.back().localMap[ptrRecord.id].insert(ptrRecord.address);
+// Pointer records are only ever visited in runs, which all go into the same
+// frame
+void AnalysisImpl::visitPointerRecords(const LogRecord* begin,
+                                       const LogRecord* end) {
+    auto& localMap = currentFrame().localMap;
+    if (objectGranularity) {
+        for (auto itr = begin; itr != end; ++itr)
+            localMap[itr->ptrRecord.id].insert(
+                allocations.getBase(itr->ptrRecord.address));
+        return;
+    }
+    for (auto itr = begin; itr != end; ++itr)
+        localMap[itr->ptrRecord.id].insert(itr->ptrRecord.address);
 }
 
 void AnalysisImpl::visitEnterRecord(const EnterRecord& enterRecord) {
-    stackFrames.push_back(Frame{enterRecord.id, LocalMap()});
+    auto& frames = stack->frames;
+    if (stack->depth == frames.size())
+        frames.emplace_back();
+    auto caller = stack->depth > 0 ? frames[stack->depth - 1].context
+                                   : CallContextTable::EmptyContext;
+    auto& frame = frames[stack->depth++];
+    frame.func = enterRecord.id;
+    // A function entered without a call record, such as a callback from
+    // uninstrumented code, stays in the context of its caller
+    frame.context = stack->pendingCall != 0
+                        ? contexts.push(caller, stack->pendingCall)
+                        : caller;
+    frame.localMap.clear();
+    frame.partial = false;
+    frame.spilled = false;
+    stack->pendingCall = 0;
 }
 
 void AnalysisImpl::visitExitRecord(const ExitRecord& exitRecord) {
-    if (stackFrames.back().func != exitRecord.id)
+    auto& frame = currentFrame();
+    if (frame.func != exitRecord.id)
         throw std::logic_error("Function entry/exit do not match");
-    findAliasPairs();
-    stackFrames.pop_back();
+
+    stack->pendingCall = 0;
+    if (frame.partial) {
+        partialFrames->push_back(PartialFrame{frame.enterOffset, frame.func,
+                                              std::move(frame.localMap)});
+        popFrame();
+        return;
+    }
+
+    auto& summary = getSummary(exitRecord.id, frame.context);
+    if (!pool) {
+        searchFrame(exitRecord.id, summary, frame.localMap, *globalAddrMap);
+    } else {
+        LocalMap localMap;
+        {
+            std::lock_guard<std::mutex> lock(freeLocalMapsMutex);
+            if (!freeLocalMaps.empty()) {
+                localMap = std::move(freeLocalMaps.back());
+                freeLocalMaps.pop_back();
+            }
+        }
+        std::swap(localMap, frame.localMap);
+
+        frameBatchSize += localMap.size() + 1;
+        frameBatch.push_back(QueuedFrame{exitRecord.id, &summary,
+                                         std::move(localMap), globalAddrMap});
+        if (frameBatchSize >= frameBatchPointers)
+            submitFrameBatch();
+    }
+    popFrame();
+}
+
+void AnalysisImpl::popFrame() {
+    --stack->depth;
+    if (stack->depth > 0 && currentFrame().spilled)
+        unspillFrame(*stack, currentFrame());
 }
 
 void AnalysisImpl::visitCallRecord(const CallRecord& callRecord) {
-    // TODO
+    stack->pendingCall = callRecord.id;
+}
+
+void AnalysisImpl::visitThreadRecord(const ThreadRecord& threadRecord) {
+    switchThread(threadRecord.id);
+}
+
+// Analyzed between two checks of the memory budget, in bytes of log
+constexpr std::size_t memoryCheckInterval = 4 << 20;
+
+void AnalysisImpl::processShard(const LogIndex& index,
+                                std::uint64_t beginOffset,
+                                std::uint64_t endOffset,
+                                std::vector<PartialFrame>& partial) {
+    if (getLogSize() != index.getLogSize())
+        throw std::runtime_error("Log index does not match the log file");
+    // Neither does the index know which thread each open frame belongs to, nor
+    // which thread is running at the start of the shard
+    if (index.getNumThreads() > 1)
+        throw std::logic_error(
+            "Logs of multi-threaded programs cannot be run on shards");
+    partialFrames = &partial;
+
+    for (auto offset : index.getGlobalOffsets()) {
+        if (offset >= beginOffset)
+            break;
+        processRecordAt(offset);
+    }
+
+    for (auto const& openFrame : index.getOpenFrames(beginOffset)) {
+        EnterRecord enterRecord;
+        enterRecord.id = openFrame.func;
+        visitEnterRecord(enterRecord);
+        currentFrame().partial = true;
+        currentFrame().enterOffset = openFrame.entry.enterOffset;
+    }
+
+    if (!hasMemoryBudget()) {
+        processRange(beginOffset, endOffset);
+    } else {
+        // The shard ends at a record boundary, so the last chunk stops right
+        // at its end
+        for (auto offset = beginOffset; offset < endOffset;) {
+            auto stopOffset =
+                std::min<std::uint64_t>(endOffset,
+                                        offset + memoryCheckInterval);
+            offset = processUntil(offset, stopOffset);
+            if (offset < stopOffset)
+                throw std::logic_error(
+                    "Shard does not end at a record boundary");
+            if (offset < endOffset)
+                enforceMemoryBudget(offset);
+        }
+    }
+
+    // Whatever is still open continues in the next shard, including the
+    // frames spilled to disk, which are read back from the top down
+    auto openFrames = index.getOpenFrames(endOffset);
+    if (openFrames.size() != stack->depth)
+        throw std::logic_error("Shard does not end at a record boundary");
+    for (auto i = stack->depth; i > 0; --i)
+        if (stack->frames[i - 1].spilled)
+            unspillFrame(*stack, stack->frames[i - 1]);
+    for (auto i = 0u; i < stack->depth; ++i) {
+        auto& frame = stack->frames[i];
+        if (frame.func != openFrames[i].func)
+            throw std::logic_error("Function entry/exit do not match");
+        partial.push_back(PartialFrame{openFrames[i].entry.enterOffset,
+                                       frame.func, std::move(frame.localMap)});
+        frame.localMap = LocalMap();
+    }
+    stack->depth = 0;
+    partialFrames = nullptr;
+}
+
+void AnalysisImpl::searchPartialFrames(const LogIndex& index,
+                                       std::vector<PartialFrame>& frames) {
+    if (getLogSize() != index.getLogSize())
+        throw std::runtime_error("Log index does not match the log file");
+
+    // Frames that never exit are not searched, just like in a complete run
+    std::vector<std::pair<std::uint64_t, PartialFrame*>> exitingFrames;
+    for (auto& frame : frames) {
+        auto exitOffset = index.getExitOffset(frame.func, frame.enterOffset);
+        if (exitOffset < index.getLogSize())
+            exitingFrames.emplace_back(exitOffset, &frame);
+    }
+    std::sort(exitingFrames.begin(), exitingFrames.end(),
+              [](const std::pair<std::uint64_t, PartialFrame*>& lhs,
+                 const std::pair<std::uint64_t, PartialFrame*>& rhs) {
+                  return lhs.first < rhs.first;
+              });
+
+    auto const& globalOffsets = index.getGlobalOffsets();
+    auto globalItr = globalOffsets.begin();
+    for (auto const& exitingFrame : exitingFrames) {
+        for (; globalItr != globalOffsets.end() &&
+               *globalItr < exitingFrame.first;
+             ++globalItr)
+            processRecordAt(*globalItr);
+
+        auto& frame = *exitingFrame.second;
+        searchFrame(frame.func,
+                    getSummary(frame.func, CallContextTable::EmptyContext),
+                    frame.localMap, *globalAddrMap);
+    }
+}
+
+// A checkpoint is a CheckpointHeader followed by the globals, the call context
+// table, the live allocations of an object-granularity analysis, the stack of
+// every thread with its open frames from the bottom up, the function summaries
+// and the alias result files of the pairs spilled so far
+const char checkpointMagic[8] = {'N', 'G', 'A', 'A', 'C', 'K', 'P', 'T'};
+constexpr std::uint32_t checkpointVersion = 5;
+// Length of the stretch of log before the checkpointed offset that is hashed,
+// to make sure a checkpoint is only resumed on the log it was taken from
+constexpr std::size_t checkpointHashedBytes = 4096;
+
+struct CheckpointHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t objectGranularity;
+    std::uint64_t logOffset;
+    std::uint64_t logHash;
+    std::uint64_t numGlobals;
+    std::uint64_t numAllocations;
+    std::uint64_t numThreads;
+    std::uint64_t numSummaries;
+    std::uint32_t contextDepth;
+    std::uint32_t currentThread;
+    std::uint64_t numSpilledRuns;
+};
+
+template <typename T> void writeValue(std::ostream& os, const T& value) {
+    os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T> void readValue(std::istream& is, T& value) {
+    is.read(reinterpret_cast<char*>(&value), sizeof(T));
+    if (!is.good())
+        throw std::runtime_error("Checkpoint file is truncated");
+}
+
+template <typename T>
+void writeArray(std::ostream& os, const std::vector<T>& vec) {
+    writeValue(os, std::uint64_t(vec.size()));
+    os.write(reinterpret_cast<const char*>(vec.data()), vec.size() * sizeof(T));
+}
+
+template <typename T> void readArray(std::istream& is, std::vector<T>& vec) {
+    std::uint64_t size;
+    readValue(is, size);
+    vec.resize(size);
+    is.read(reinterpret_cast<char*>(vec.data()), size * sizeof(T));
+    if (!is.good())
+        throw std::runtime_error("Checkpoint file is truncated");
+}
+
+// A local map is its number of pointers followed by each pointer and its
+// points-to set
+void writeLocalMap(std::ostream& os, const LocalMap& localMap) {
+    std::vector<std::uint64_t> addrs;
+    writeValue(os, std::uint64_t(localMap.size()));
+    for (auto const& mapping : localMap) {
+        addrs.clear();
+        for (auto addr : mapping.second)
+            addrs.push_back(reinterpret_cast<std::uint64_t>(addr));
+        writeValue(os, mapping.first);
+        writeArray(os, addrs);
+    }
+}
+
+void readLocalMap(std::istream& is, LocalMap& localMap) {
+    std::vector<std::uint64_t> addrs;
+    std::uint64_t numPointers;
+    readValue(is, numPointers);
+    for (std::uint64_t i = 0; i < numPointers; ++i) {
+        DynamicPointer id;
+        readValue(is, id);
+        readArray(is, addrs);
+        auto& ptsSet = localMap[id];
+        for (auto addr : addrs)
+            ptsSet.insert(reinterpret_cast<const void*>(addr));
+    }
+}
+
+void copyBytes(std::istream& is, std::ostream& os, std::uint64_t size) {
+    char buffer[1 << 16];
+    while (size > 0) {
+        auto chunk = std::min<std::uint64_t>(size, sizeof(buffer));
+        is.read(buffer, chunk);
+        if (!is.good())
+            throw std::runtime_error("Spilled file is truncated");
+        os.write(buffer, chunk);
+        size -= chunk;
+    }
+}
+
+void FunctionSummary::writeTo(std::ostream& os) const {
+    writeArray(os, localPointers);
+    writeValue(os, std::uint8_t(tracked));
+    writeValue(os, numPairs);
+    writeArray(os, pairBits);
+    writeArray(os, numPartners);
+
+    std::vector<DynamicPointer> pairIDs;
+    pairIDs.reserve(pairs.size() * 2);
+    for (auto const& pair : pairs) {
+        pairIDs.push_back(pair.getFirst());
+        pairIDs.push_back(pair.getSecond());
+    }
+    writeArray(os, pairIDs);
+}
+
+void FunctionSummary::readFrom(std::istream& is) {
+    readArray(is, localPointers);
+    localIndex.clear();
+    for (auto i = 0u; i < localPointers.size(); ++i)
+        localIndex[localPointers[i]] = i;
+    std::uint8_t isTracked;
+    readValue(is, isTracked);
+    tracked = isTracked;
+    readValue(is, numPairs);
+    readArray(is, pairBits);
+    readArray(is, numPartners);
+
+    std::vector<DynamicPointer> pairIDs;
+    readArray(is, pairIDs);
+    pairs.clear();
+    pairs.reserve(pairIDs.size() / 2);
+    for (std::size_t i = 0; i + 1 < pairIDs.size(); i += 2)
+        pairs.insert(AliasPair(pairIDs[i], pairIDs[i + 1]));
+}
+
+// FNV-1a over the bytes right before logOffset
+std::uint64_t AnalysisImpl::hashLogBefore(std::size_t logOffset) const {
+    auto begin = logOffset > checkpointHashedBytes
+                     ? logOffset - checkpointHashedBytes
+                     : std::size_t(0);
+    auto data = getReader().data();
+    std::uint64_t hash = 14695981039346656037ull;
+    for (auto i = begin; i < logOffset; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+void AnalysisImpl::writeCheckpoint(const char* fileName,
+                                   std::size_t logOffset) {
+    drainWorkers();
+
+    auto tmpFileName = std::string(fileName) + ".tmp";
+    std::ofstream ofs(tmpFileName,
+                      std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open())
+        throw std::runtime_error("Cannot open checkpoint file " + tmpFileName);
+
+    CheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+    header.version = checkpointVersion;
+    header.logOffset = logOffset;
+    header.logHash = hashLogBefore(logOffset);
+    header.numGlobals = globalMap.size();
+    header.objectGranularity = objectGranularity;
+    header.numAllocations = allocations.size();
+    header.numThreads = threadStacks.size();
+    header.numSummaries = summaries.size();
+    header.contextDepth = contexts.getMaxDepth();
+    header.currentThread = currentThread;
+    header.numSpilledRuns = spilledRuns.size();
+    writeValue(ofs, header);
+
+    for (auto const& mapping : globalMap) {
+        writeValue(ofs, mapping.first);
+        writeValue(ofs, reinterpret_cast<std::uint64_t>(mapping.second));
+    }
+    contexts.writeTo(ofs);
+    allocations.forEach([&ofs](const AllocationIndex::Allocation& alloc) {
+        writeValue(ofs, std::uint64_t(alloc.begin));
+        writeValue(ofs, std::uint64_t(alloc.end - alloc.begin));
+    });
+
+    for (auto& mapping : threadStacks) {
+        auto& threadStack = mapping.second;
+        writeValue(ofs, mapping.first);
+        writeValue(ofs, threadStack.pendingCall);
+        writeValue(ofs, std::uint64_t(threadStack.depth));
+        for (auto i = 0u; i < threadStack.depth; ++i) {
+            auto const& frame = threadStack.frames[i];
+            writeValue(ofs, frame.func);
+            writeValue(ofs, frame.context);
+            // A spilled local map is already in the right format
+            if (frame.spilled) {
+                threadStack.spillFile.seekg(frame.spillOffset);
+                copyBytes(threadStack.spillFile, ofs, frame.spillSize);
+            } else
+                writeLocalMap(ofs, frame.localMap);
+        }
+    }
+
+    for (auto const& mapping : summaries) {
+        writeValue(ofs, mapping.first.first);
+        writeValue(ofs, mapping.first.second);
+        mapping.second->writeTo(ofs);
+    }
+
+    for (auto const& run : spilledRuns) {
+        std::ifstream ifs(run, std::ios::in | std::ios::binary | std::ios::ate);
+        std::uint64_t size = ifs.tellg();
+        ifs.seekg(0);
+        writeValue(ofs, size);
+        copyBytes(ifs, ofs, size);
+    }
+
+    ofs.close();
+    if (!ofs.good())
+        throw std::runtime_error("Cannot write checkpoint file " + tmpFileName);
+    if (std::rename(tmpFileName.data(), fileName) != 0)
+        throw std::runtime_error(std::string("Cannot replace checkpoint file ") +
+                                 fileName);
+}
+
+std::size_t AnalysisImpl::readCheckpoint(const char* fileName) {
+    std::ifstream ifs(fileName, std::ios::in | std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error(std::string("Cannot open checkpoint file ") +
+                                 fileName);
+
+    CheckpointHeader header;
+    readValue(ifs, header);
+    if (std::memcmp(header.magic, checkpointMagic, sizeof(checkpointMagic)) !=
+            0 ||
+        header.version != checkpointVersion)
+        throw std::runtime_error(std::string(fileName) +
+                                 " is not a checkpoint file of version " +
+                                 std::to_string(checkpointVersion));
+    if (header.logOffset > getLogSize() ||
+        header.logHash != hashLogBefore(header.logOffset))
+        throw std::runtime_error(std::string("Checkpoint file ") + fileName +
+                                 " was not taken from this log");
+    if (header.contextDepth != contexts.getMaxDepth())
+        throw std::runtime_error(
+            std::string("Checkpoint file ") + fileName +
+            " was taken with a context depth of " +
+            std::to_string(header.contextDepth));
+    if (bool(header.objectGranularity) != objectGranularity)
+        throw std::runtime_error(std::string("Checkpoint file ") + fileName +
+                                 " was taken with " +
+                                 (header.objectGranularity ? "object"
+                                                           : "address") +
+                                 " granularity");
+
+    for (auto i = 0u; i < header.numGlobals; ++i) {
+        DynamicPointer id;
+        std::uint64_t addr;
+        readValue(ifs, id);
+        readValue(ifs, addr);
+        AllocRecord allocRecord;
+        allocRecord.type = AllocType::Global;
+        allocRecord.id = id;
+        allocRecord.address = reinterpret_cast<void*>(addr);
+        allocRecord.size = 0;
+        visitAllocRecord(allocRecord);
+    }
+    contexts.readFrom(ifs);
+    for (std::uint64_t i = 0; i < header.numAllocations; ++i) {
+        std::uint64_t addr, size;
+        readValue(ifs, addr);
+        readValue(ifs, size);
+        if (size == 0)
+            throw std::runtime_error("Checkpoint file is corrupted");
+        allocations.insert(reinterpret_cast<const void*>(addr), size);
+    }
+
+    for (std::uint64_t i = 0; i < header.numThreads; ++i) {
+        unsigned thread;
+        DynamicPointer call;
+        std::uint64_t numFrames;
+        readValue(ifs, thread);
+        readValue(ifs, call);
+        readValue(ifs, numFrames);
+        switchThread(thread);
+        for (std::uint64_t j = 0; j < numFrames; ++j) {
+            EnterRecord enterRecord;
+            readValue(ifs, enterRecord.id);
+            visitEnterRecord(enterRecord);
+            readValue(ifs, currentFrame().context);
+            if (currentFrame().context >= contexts.size())
+                throw std::runtime_error("Checkpoint file is corrupted");
+            readLocalMap(ifs, currentFrame().localMap);
+        }
+        stack->pendingCall = call;
+    }
+    switchThread(header.currentThread);
+
+    for (auto i = 0u; i < header.numSummaries; ++i) {
+        DynamicPointer func;
+        ContextID ctx;
+        readValue(ifs, func);
+        readValue(ifs, ctx);
+        auto& summary = summaries[ContextKey(func, ctx)];
+        summary.reset(new FunctionSummary());
+        summary->readFrom(ifs);
+    }
+
+    // The spilled pairs go back to disk instead of into memory
+    for (std::uint64_t i = 0; i < header.numSpilledRuns; ++i) {
+        std::uint64_t size;
+        readValue(ifs, size);
+        auto run = getSpilledRunName(spilledRuns.size());
+        std::ofstream ofs(run,
+                          std::ios::out | std::ios::binary | std::ios::trunc);
+        spilledRuns.push_back(run);
+        copyBytes(ifs, ofs, size);
+        if (!ofs.good())
+            throw std::runtime_error("Cannot write spilled pairs to " + run);
+    }
+
+    return header.logOffset;
+}
+
+void AnalysisImpl::setMemoryBudget(std::size_t budget,
+                                   const std::string& prefix) {
+    // Spilled pairs are only kept per function
+    if (budget != 0 && contexts.getMaxDepth() > 0)
+        throw std::logic_error(
+            "Context-sensitive analysis cannot be memory-bounded");
+    memoryBudget = budget;
+    spillPrefix = prefix;
+}
+
+std::size_t AnalysisImpl::getMemoryUsage() const {
+    auto usage = globalMap.getMemorySize() + globalAddrMap->getMemorySize() +
+                 summaries.getMemorySize() + allocations.getMemoryUsage();
+    for (auto const& mapping : summaries)
+        usage += mapping.second->getMemoryUsage();
+    for (auto const& mapping : threadStacks) {
+        usage += sizeof(ThreadStack) +
+                 mapping.second.frames.capacity() * sizeof(Frame);
+        for (auto const& frame : mapping.second.frames)
+            usage += frame.localMap.getMemoryUsage();
+    }
+    for (auto const& localMap : freeLocalMaps)
+        usage += localMap.getMemoryUsage();
+    return usage;
+}
+
+void AnalysisImpl::enforceMemoryBudget(std::size_t logOffset) {
+    if (memoryBudget == 0)
+        return;
+    // The workers must not touch the summaries or return local maps while
+    // they are measured and spilled
+    drainWorkers();
+    dropLogBefore(logOffset);
+    if (getMemoryUsage() <= memoryBudget)
+        return;
+
+    // Storage only kept around for reuse goes first, including the stacks of
+    // threads that have nothing open, then the pairs found so far and last
+    // the frames that are not going to be touched for a while
+    for (auto itr = threadStacks.begin(); itr != threadStacks.end();) {
+        auto curr = itr++;
+        auto& threadStack = curr->second;
+        if (threadStack.depth == 0 && threadStack.pendingCall == 0 &&
+            curr->first != currentThread) {
+            removeSpilledFrames(curr->first, threadStack);
+            threadStacks.erase(curr);
+            continue;
+        }
+        threadStack.frames.resize(threadStack.depth);
+        threadStack.frames.shrink_to_fit();
+    }
+    freeLocalMaps = std::vector<LocalMap>();
+    if (getMemoryUsage() > memoryBudget)
+        spillSummaries();
+    if (getMemoryUsage() > memoryBudget)
+        for (auto& mapping : threadStacks)
+            spillColdFrames(mapping.first, mapping.second);
+#ifdef __GLIBC__
+    // Hand the memory freed by spilling back to the system
+    ::malloc_trim(0);
+#endif
+}
+
+void AnalysisImpl::spillSummaries() {
+    std::vector<std::pair<DynamicPointer, const AliasPairSet*>> sets;
+    for (auto& mapping : summaries) {
+        auto& pairs = mapping.second->pairs;
+        if (pairs.empty())
+            continue;
+        pairs.freeze();
+        sets.emplace_back(mapping.first.first, &pairs);
+    }
+    if (sets.empty())
+        return;
+
+    // Pairs found again after the spill are spilled again or kept in the
+    // summaries, and the duplicates disappear once the runs are merged back
+    std::sort(sets.begin(), sets.end());
+    auto run = getSpilledRunName(spilledRuns.size());
+    spilledRuns.push_back(run);
+    AliasResultFile::writePairSets(run.data(), sets);
+    for (auto& mapping : summaries)
+        mapping.second->pairs.clear();
+    ++numSpilledRuns;
+}
+
+// Frames this close to the top of the stack are likely to be written to again
+// soon, and are never spilled
+constexpr std::size_t hotFrames = 16;
+
+// Each thread spills to a file of its own, since its frames are read back in
+// the order of its own stack
+void AnalysisImpl::spillColdFrames(unsigned thread, ThreadStack& threadStack) {
+    if (threadStack.depth <= hotFrames)
+        return;
+    auto& spillFile = threadStack.spillFile;
+    if (!spillFile.is_open()) {
+        auto fileName = getSpilledFramesName(thread);
+        spillFile.open(fileName, std::ios::in | std::ios::out |
+                                     std::ios::binary | std::ios::trunc);
+        if (!spillFile.is_open())
+            throw std::runtime_error("Cannot open " + fileName);
+    }
+
+    // Only frames above the last spilled one can be appended without breaking
+    // the stack order of the file
+    auto& frames = threadStack.frames;
+    auto first = threadStack.depth;
+    while (first > 0 && !frames[first - 1].spilled)
+        --first;
+    spillFile.seekp(threadStack.spillEnd);
+    for (auto i = first; i < threadStack.depth - hotFrames; ++i) {
+        auto& frame = frames[i];
+        if (frame.localMap.size() == 0)
+            continue;
+        frame.spilled = true;
+        frame.spillOffset = threadStack.spillEnd;
+        writeLocalMap(spillFile, frame.localMap);
+        threadStack.spillEnd = spillFile.tellp();
+        frame.spillSize = threadStack.spillEnd - frame.spillOffset;
+        frame.localMap = LocalMap();
+        ++numSpilledFrames;
+    }
+    if (!spillFile.good())
+        throw std::runtime_error("Cannot spill frames to " +
+                                 getSpilledFramesName(thread));
+}
+
+void AnalysisImpl::unspillFrame(ThreadStack& threadStack, Frame& frame) {
+    threadStack.spillFile.seekg(frame.spillOffset);
+    readLocalMap(threadStack.spillFile, frame.localMap);
+    // Every frame spilled after this one is above it and has been read back
+    // already, so the space they took can be reused
+    threadStack.spillEnd = frame.spillOffset;
+    frame.spilled = false;
+}
+
+void AnalysisImpl::removeSpilledFrames(unsigned thread,
+                                       ThreadStack& threadStack) {
+    if (!threadStack.spillFile.is_open())
+        return;
+    threadStack.spillFile.close();
+    std::remove(getSpilledFramesName(thread).data());
+}
+
+// A partial frame file is a header followed by the partial frames, each with
+// its local map
+const char partialFramesMagic[8] = {'N', 'G', 'P', 'A', 'R', 'T', 'F', 'R'};
+constexpr std::uint32_t partialFramesVersion = 1;
+
+struct PartialFramesHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t numFrames;
+};
+
+void writePartialFrames(const char* fileName,
+                        const std::vector<PartialFrame>& frames) {
+    std::ofstream ofs(fileName,
+                      std::ios::out | std::ios::binary | std::ios::trunc);
+
+    PartialFramesHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, partialFramesMagic, sizeof(header.magic));
+    header.version = partialFramesVersion;
+    header.numFrames = frames.size();
+    writeValue(ofs, header);
+
+    for (auto const& frame : frames) {
+        writeValue(ofs, frame.enterOffset);
+        writeValue(ofs, frame.func);
+        writeLocalMap(ofs, frame.localMap);
+    }
+    if (!ofs.good())
+        throw std::runtime_error(
+            std::string("Cannot write partial frames to ") + fileName);
+}
+
+void readPartialFrames(const char* fileName,
+                       std::vector<PartialFrame>& frames) {
+    std::ifstream ifs(fileName, std::ios::in | std::ios::binary);
+    if (!ifs.is_open())
+        throw std::runtime_error(
+            std::string("Cannot open partial frame file ") + fileName);
+
+    PartialFramesHeader header;
+    readValue(ifs, header);
+    if (std::memcmp(header.magic, partialFramesMagic,
+                    sizeof(partialFramesMagic)) != 0 ||
+        header.version != partialFramesVersion)
+        throw std::runtime_error(std::string(fileName) +
+                                 " is not a partial frame file of version " +
+                                 std::to_string(partialFramesVersion));
+
+    for (std::uint64_t i = 0; i < header.numFrames; ++i) {
+        PartialFrame frame;
+        readValue(ifs, frame.enterOffset);
+        readValue(ifs, frame.func);
+        readLocalMap(ifs, frame.localMap);
+        frames.push_back(std::move(frame));
+    }
+}
+
+// Unique in the process, so that analyses never share spilled files
+std::string makeSpillPrefix(std::string directory) {
+    static std::atomic<unsigned> numPrefixes(0);
+    if (directory.empty()) {
+        auto tmpDir = std::getenv("TMPDIR");
+        directory = tmpDir != nullptr ? tmpDir : "/tmp";
+    }
+    return directory + "/dyn-aa-" + std::to_string(::getpid()) + "-" +
+           std::to_string(numPrefixes++);
 }
 }
 
 DynamicAliasAnalysis::DynamicAliasAnalysis(const char* fileName)
-    : fileName(fileName) {}
+    : maxContextSummaries(0), numDegradedSummaries(0), memoryBudget(0),
+      numSpilledRuns(0), numSpilledFrames(0), objectGranularity(false),
+      fileName(fileName) {}
+
+void DynamicAliasAnalysis::setContextSensitivity(unsigned depth,
+                                                 std::size_t maxContexts,
+                                                 std::size_t maxSummaries) {
+    contextTable = CallContextTable(depth, maxContexts);
+    maxContextSummaries = maxSummaries;
+}
+
+void DynamicAliasAnalysis::setMemoryBudget(std::size_t budget,
+                                           const std::string& directory) {
+    memoryBudget = budget;
+    spillDirectory = directory;
+}
+
+void DynamicAliasAnalysis::runAnalysis(unsigned numDecoders,
+                                       unsigned numWorkers) {
+    // The budget is checked between chunks of the log, which the decoder
+    // threads do not stop at
+    if (memoryBudget != 0)
+        return runCheckpointedAnalysis(nullptr, 0, nullptr, numWorkers);
+
+    AnalysisImpl impl(fileName, aliasPairMap, contextAliasPairMap, contextTable,
+                      maxContextSummaries, numWorkers);
+    impl.setObjectGranularity(objectGranularity);
+    impl.setPairListener(pairListener);
+    impl.process(numDecoders);
+    impl.finish();
+    numDegradedSummaries = impl.getNumDegradedSummaries();
+}
+
+void DynamicAliasAnalysis::runCheckpointedAnalysis(
+    const char* checkpointFile, std::uint64_t checkpointInterval,
+    const char* resumeFile, unsigned numWorkers) {
+    AnalysisImpl impl(fileName, aliasPairMap, contextAliasPairMap, contextTable,
+                      maxContextSummaries, numWorkers);
+    impl.setObjectGranularity(objectGranularity);
+    impl.setPairListener(pairListener);
+    impl.setMemoryBudget(memoryBudget, makeSpillPrefix(spillDirectory));
+    std::size_t logOffset = 0;
+    if (resumeFile != nullptr)
+        logOffset = impl.readCheckpoint(resumeFile);
+
+    auto logSize = impl.getLogSize();
+    auto checkpointOffset = logOffset;
+    while (true) {
+        auto stopOffset = logSize;
+        if (checkpointFile != nullptr && checkpointInterval != 0 &&
+            logSize - checkpointOffset > checkpointInterval)
+            stopOffset = checkpointOffset + checkpointInterval;
+        if (impl.hasMemoryBudget() &&
+            logSize - logOffset > memoryCheckInterval)
+            stopOffset =
+                std::min(stopOffset, logOffset + memoryCheckInterval);
+
+        logOffset = impl.processUntil(logOffset, stopOffset);
+        // Either the end of the log or a record that is not completely
+        // written yet has been reached
+        if (stopOffset == logSize || logOffset < stopOffset)
+            break;
+        impl.enforceMemoryBudget(logOffset);
+        if (checkpointFile != nullptr && checkpointInterval != 0 &&
+            logOffset - checkpointOffset >= checkpointInterval) {
+            impl.writeCheckpoint(checkpointFile, logOffset);
+            checkpointOffset = logOffset;
+        }
+    }
+
+    if (checkpointFile != nullptr)
+        impl.writeCheckpoint(checkpointFile, logOffset);
+    impl.finish();
+    numDegradedSummaries = impl.getNumDegradedSummaries();
+    numSpilledRuns += impl.getNumSpilledRuns();
+    numSpilledFrames += impl.getNumSpilledFrames();
+}
+
+void DynamicAliasAnalysis::runAnalysisOnFunctions(
+    const LogIndex& index, const std::vector<DynamicPointer>& funcs) {
+    // Objects allocated outside of the replayed frames are not known
+    if (objectGranularity)
+        throw std::logic_error("Object-granularity analysis cannot be run on "
+                               "selected functions");
+    // Only a few frames are replayed, so the budget is not checked
+    if (memoryBudget != 0)
+        throw std::logic_error(
+            "Analysis of selected functions cannot be memory-bounded");
+    AnalysisImpl impl(fileName, aliasPairMap, contextAliasPairMap, contextTable,
+                      maxContextSummaries);
+    impl.setPairListener(pairListener);
+    if (impl.getLogSize() != index.getLogSize())
+        throw std::runtime_error("Log index does not match the log file");
+    // The records of other threads in between would land on stacks that the
+    // replay has not seen the bottom of
+    if (index.getNumThreads() > 1)
+        throw std::logic_error("Logs of multi-threaded programs cannot be "
+                               "analyzed one function at a time");
+
+    std::vector<LogIndex::FrameEntry> frames;
+    for (auto func : funcs) {
+        auto range = index.getFrames(func);
+        frames.insert(frames.end(), range.first, range.second);
+    }
+    std::sort(frames.begin(), frames.end(),
+              [](const LogIndex::FrameEntry& lhs,
+                 const LogIndex::FrameEntry& rhs) {
+                  return lhs.enterOffset < rhs.enterOffset;
+              });
+
+    // Every frame sees the globals allocated before it, so the global
+    // allocations in between the analyzed frames are replayed in log order
+    auto const& globalOffsets = index.getGlobalOffsets();
+    auto globalItr = globalOffsets.begin();
+    auto globalIte = globalOffsets.end();
+    std::uint64_t analyzedEnd = 0;
+    for (auto const& frame : frames) {
+        // Frames nested in an analyzed frame have been analyzed along with it
+        if (frame.enterOffset < analyzedEnd)
+            continue;
+
+        for (; globalItr != globalIte && *globalItr < frame.enterOffset;
+             ++globalItr)
+            impl.processRecordAt(*globalItr);
+
+        analyzedEnd = frame.exitOffset;
+        if (analyzedEnd < index.getLogSize())
+            analyzedEnd += getEncodedRecordSize(TExitRec);
+        impl.processRange(frame.enterOffset, analyzedEnd);
+
+        while (globalItr != globalIte && *globalItr < analyzedEnd)
+            ++globalItr;
+    }
+    impl.finish();
+    numDegradedSummaries = impl.getNumDegradedSummaries();
+
+    // Only the invocations of callees made by the selected functions have been
+    // seen, so their summaries would be incomplete
+    DenseSet<DynamicPointer> selected;
+    for (auto func : funcs)
+        selected.insert(func);
+    for (auto itr = aliasPairMap.begin(), ite = aliasPairMap.end();
+         itr != ite;) {
+        auto curr = itr++;
+        if (!selected.count(curr->first))
+            aliasPairMap.erase(curr);
+    }
+    for (auto itr = contextAliasPairMap.begin(),
+              ite = contextAliasPairMap.end();
+         itr != ite;) {
+        auto curr = itr++;
+        if (!selected.count(curr->first.first))
+            contextAliasPairMap.erase(curr);
+    }
+}
+
+void DynamicAliasAnalysis::runAnalysisOnShard(const LogIndex& index,
+                                              std::uint64_t beginOffset,
+                                              std::uint64_t endOffset,
+                                              const char* partialFramesFile,
+                                              unsigned numWorkers) {
+    // The call strings leading into a shard are not known
+    if (contextTable.getMaxDepth() > 0)
+        throw std::logic_error(
+            "Context-sensitive analysis cannot be run on shards");
+    // Neither are the objects allocated before the shard
+    if (objectGranularity)
+        throw std::logic_error(
+            "Object-granularity analysis cannot be run on shards");
+
+    AnalysisImpl impl(fileName, aliasPairMap, contextAliasPairMap, contextTable,
+                      maxContextSummaries, numWorkers);
+    impl.setPairListener(pairListener);
+    impl.setMemoryBudget(memoryBudget, makeSpillPrefix(spillDirectory));
+    std::vector<PartialFrame> partialFrames;
+    impl.processShard(index, beginOffset, endOffset, partialFrames);
+    impl.finish();
+    numSpilledRuns += impl.getNumSpilledRuns();
+    numSpilledFrames += impl.getNumSpilledFrames();
+    writePartialFrames(partialFramesFile, partialFrames);
+}
+
+void DynamicAliasAnalysis::reducePartialFrames(
+    const LogIndex& index, const std::vector<std::string>& partialFramesFiles) {
+    std::vector<PartialFrame> pieces;
+    for (auto const& file : partialFramesFiles)
+        readPartialFrames(file.data(), pieces);
+
+    // Put the pieces of each frame together
+    std::sort(pieces.begin(), pieces.end(),
+              [](const PartialFrame& lhs, const PartialFrame& rhs) {
+                  return lhs.enterOffset < rhs.enterOffset;
+              });
+    std::vector<PartialFrame> frames;
+    for (auto& piece : pieces) {
+        if (frames.empty() || frames.back().enterOffset != piece.enterOffset) {
+            frames.push_back(std::move(piece));
+            continue;
+        }
+        auto& localMap = frames.back().localMap;
+        for (auto const& mapping : piece.localMap) {
+            auto& ptsSet = localMap[mapping.first];
+            for (auto addr : mapping.second)
+                ptsSet.insert(addr);
+        }
+    }
+    pieces = std::vector<PartialFrame>();
 
-void DynamicAliasAnalysis::runAnalysis() {
-    AnalysisImpl(fileName, aliasPairMap).process();
+    AnalysisImpl impl(fileName, aliasPairMap, contextAliasPairMap, contextTable,
+                      maxContextSummaries);
+    impl.setPairListener(pairListener);
+    impl.searchPartialFrames(index, frames);
+    impl.finish();
 }
 
-const DynamicAliasAnalysis::AliasPairSet* DynamicAliasAnalysis::getAliasPairs(
-    DynamicPointer p) const {
+const AliasPairSet*
+DynamicAliasAnalysis::getAliasPairs(DynamicPointer p) const {
     auto itr = aliasPairMap.find(p);
     if (itr == aliasPairMap.end())
         return nullptr;
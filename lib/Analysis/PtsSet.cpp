@@ -0,0 +1,120 @@
+#include "Dynamic/Analysis/PtsSet.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace dynamic {
+
+namespace {
+
+using Addr = std::uintptr_t;
+
+// Past this ratio between the sizes of two sets, looking up the addresses of
+// the smaller one in the larger one beats merging them
+constexpr std::size_t lookupRatio = 16;
+
+bool intersectsByLookup(const Addr* small, std::size_t smallSize,
+                        const Addr* large, std::size_t largeSize) {
+    auto pos = large, end = large + largeSize;
+    for (auto i = 0u; i < smallSize; ++i) {
+        pos = std::lower_bound(pos, end, small[i]);
+        if (pos == end)
+            return false;
+        if (*pos == small[i])
+            return true;
+    }
+    return false;
+}
+
+// Compare a block of addresses of each set against all of the other block,
+// and move past the block with the smaller maximum, or both if the maxima are
+// equal. Blocks of addresses in between have been compared to their
+// neighbours already, so what is left is merged one address at a time.
+bool intersectsByMerge(const Addr* lhs, std::size_t lhsSize, const Addr* rhs,
+                       std::size_t rhsSize) {
+    std::size_t i = 0, j = 0;
+#if defined(__AVX2__)
+    while (i + 4 <= lhsSize && j + 4 <= rhsSize) {
+        auto lv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+        auto rv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + j));
+        // Compare against every rotation of the block of rhs
+        auto eq = _mm256_cmpeq_epi64(lv, rv);
+        for (auto k = 1; k < 4; ++k) {
+            rv = _mm256_permute4x64_epi64(rv, _MM_SHUFFLE(0, 3, 2, 1));
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(lv, rv));
+        }
+        if (!_mm256_testz_si256(eq, eq))
+            return true;
+        auto lhsMax = lhs[i + 3], rhsMax = rhs[j + 3];
+        i += lhsMax <= rhsMax ? 4 : 0;
+        j += rhsMax <= lhsMax ? 4 : 0;
+    }
+#elif defined(__SSE2__)
+    // SSE2 only compares 32-bit lanes: an address matches if both of its
+    // halves do
+    auto eq64 = [](__m128i a, __m128i b) {
+        auto eq = _mm_cmpeq_epi32(a, b);
+        return _mm_and_si128(eq,
+                             _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+    };
+    while (i + 2 <= lhsSize && j + 2 <= rhsSize) {
+        auto lv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i));
+        auto rv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + j));
+        auto eq = _mm_or_si128(
+            eq64(lv, rv),
+            eq64(lv, _mm_shuffle_epi32(rv, _MM_SHUFFLE(1, 0, 3, 2))));
+        if (_mm_movemask_epi8(eq) != 0)
+            return true;
+        auto lhsMax = lhs[i + 1], rhsMax = rhs[j + 1];
+        i += lhsMax <= rhsMax ? 2 : 0;
+        j += rhsMax <= lhsMax ? 2 : 0;
+    }
+#endif
+    while (i < lhsSize && j < rhsSize) {
+        if (lhs[i] == rhs[j])
+            return true;
+        if (lhs[i] < rhs[j])
+            ++i;
+        else
+            ++j;
+    }
+    return false;
+}
+}
+
+void PtsSet::normalize() {
+    if (isNormalized())
+        return;
+    // The sorted prefix usually holds most of the addresses, so only the ones
+    // appended since are sorted before the two are merged
+    auto sortedEnd = addrs.begin() + numSorted;
+    std::sort(sortedEnd, addrs.end());
+    std::inplace_merge(addrs.begin(), sortedEnd, addrs.end());
+    addrs.erase(std::unique(addrs.begin(), addrs.end()), addrs.end());
+    numSorted = addrs.size();
+}
+
+bool PtsSet::intersects(const PtsSet& other) const {
+    if (empty() || other.empty())
+        return false;
+    static_assert(sizeof(const void*) == sizeof(Addr),
+                  "Addresses are compared as integers");
+    auto lhs = reinterpret_cast<const Addr*>(addrs.data());
+    auto rhs = reinterpret_cast<const Addr*>(other.addrs.data());
+    auto lhsSize = size(), rhsSize = other.size();
+
+    // Sets whose ranges of addresses do not overlap cannot share one
+    if (lhs[lhsSize - 1] < rhs[0] || rhs[rhsSize - 1] < lhs[0])
+        return false;
+
+    if (lhsSize * lookupRatio < rhsSize)
+        return intersectsByLookup(lhs, lhsSize, rhs, rhsSize);
+    if (rhsSize * lookupRatio < lhsSize)
+        return intersectsByLookup(rhs, rhsSize, lhs, lhsSize);
+    return intersectsByMerge(lhs, lhsSize, rhs, rhsSize);
+}
+}
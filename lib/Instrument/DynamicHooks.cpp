@@ -22,6 +22,10 @@ Type* getIntType(const Module& m) {
     return Type::getIntNTy(m.getContext(), sizeof(int) * 8);
 }
 
+Type* getLongType(const Module& m) {
+    return Type::getIntNTy(m.getContext(), sizeof(size_t) * 8);
+}
+
 Type* getCharPtrType(const Module& m) {
     return PointerType::getUnqual(getCharType(m));
 }
@@ -42,8 +46,8 @@ Function* createFunctionWithArgType(const StringRef& name,
 DynamicHooks::DynamicHooks(Module& module) {
     initHook = createFunctionWithArgType("HookInit", {}, module);
     allocHook = createFunctionWithArgType(
-        "HookAlloc",
-        {getCharType(module), getIntType(module), getCharPtrType(module)},
+        "HookSizedAlloc", {getCharType(module), getIntType(module),
+                           getCharPtrType(module), getLongType(module)},
         module);
     pointerHook = createFunctionWithArgType(
         "HookPointer", {getIntType(module), getCharPtrType(module)}, module);
@@ -54,6 +58,9 @@ DynamicHooks::DynamicHooks(Module& module) {
     exitHook =
         createFunctionWithArgType("HookExit", {getIntType(module)}, module);
     globalHook = createFunctionWithArgType("HookGlobal", {}, module);
+    // Each module logs its own globals from a constructor of its own, so
+    // the hook must not clash with the ones of other modules at link time
+    globalHook->setLinkage(GlobalValue::InternalLinkage);
     mainHook = createFunctionWithArgType(
         "HookMain", {getIntType(module), getCharPtrPtrType(module),
                      getIntType(module), getCharPtrPtrType(module)},
@@ -2,20 +2,25 @@
 
 #include <llvm/IR/Module.h>
 #include <llvm/IR/User.h>
+#include <llvm/Support/ErrorHandling.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
+
 using namespace llvm;
 
 namespace dynamic {
 
-static constexpr IDType startID = 1u;
-
 bool IDAssigner::assignValueID(const Value* v) {
     assert(v != nullptr);
 
     if (idMap.count(v))
         return false;
 
+    if (nextID == endID)
+        report_fatal_error("Module has too many values to fit into the ID "
+                           "range of its module ID");
+
     idMap[v] = nextID;
     assert(nextID == startID + revIdMap.size());
     revIdMap.push_back(v);
@@ -36,7 +41,21 @@ bool IDAssigner::assignUserID(const User* u) {
     return changed;
 }
 
-IDAssigner::IDAssigner(const Module& module) : nextID(startID) {
+IDAssigner::IDAssigner(const Module& module, unsigned moduleID) {
+    assert(moduleID <= MaxModuleID && "Module ID out of range");
+    // ID 0 is reserved to mean "no value", and the two largest IDs are the
+    // empty/tombstone keys of DenseMap<IDType, ...>
+    const IDType maxEndID = ~0u - 1;
+    if (moduleID == 0) {
+        startID = 1u;
+        endID = maxEndID;
+    } else {
+        startID = moduleID << LocalIDBits;
+        endID = std::min<std::uint64_t>(
+            std::uint64_t(startID) + (1u << LocalIDBits), maxEndID);
+    }
+    nextID = startID;
+
     for (auto const& g : module.globals()) {
         assignValueID(&g);
         // if (g.hasInitializer())
@@ -66,7 +85,7 @@ const IDType* IDAssigner::getID(const llvm::Value& v) const {
 }
 
 const llvm::Value* IDAssigner::getValue(IDType id) const {
-    if (id >= revIdMap.size())
+    if (id < startID || id - startID >= revIdMap.size())
         return nullptr;
     else
         return revIdMap[id - startID];
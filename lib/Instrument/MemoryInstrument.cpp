@@ -4,11 +4,15 @@
 #include "Dynamic/Instrument/FeatureCheck.h"
 #include "Dynamic/Instrument/IDAssigner.h"
 
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/Analysis/CaptureTracking.h>
 #include <llvm/IR/CallSite.h>
 #include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
 
 using namespace llvm;
 
@@ -16,6 +20,10 @@ namespace dynamic {
 
 namespace {
 
+// The global hook has to run before any other constructor of the program,
+// since those may call instrumented functions
+constexpr int globalHookPriority = 1;
+
 BasicBlock::iterator nextInsertionPos(Instruction& inst) {
     BasicBlock::iterator loc(&inst);
     ++loc;
@@ -36,6 +44,10 @@ private:
     const IDAssigner& idMap;
 
     LLVMContext& context;
+    const DataLayout& dataLayout;
+
+    bool skipLocalAllocas;
+    SmallPtrSet<const AllocaInst*, 16> localAllocas;
 
     size_t getID(const Value& v) const {
         auto id = idMap.getID(v);
@@ -47,10 +59,25 @@ private:
     Type* getCharType() { return Type::getInt8Ty(context); }
     Type* getCharPtrType() { return PointerType::getUnqual(getCharType()); }
 
+    Value* getTypeSize(Type* ty) {
+        return ConstantInt::get(getLongType(),
+                                dataLayout.getTypeAllocSize(ty));
+    }
+    Value* getUnknownSize() { return ConstantInt::get(getLongType(), 0); }
+    Value* castToLong(Value* val, Instruction* pos) {
+        if (val->getType() == getLongType())
+            return val;
+        return CastInst::CreateIntegerCast(val, getLongType(), false,
+                                           "alloc_size", pos);
+    }
+    Value* getMallocSize(CallSite cs, Instruction* pos);
+
     void instrumentPointer(Value*, Instruction*);
-    void instrumentAllocation(AllocType, Value*, Instruction*);
+    // A size of 0 means that the size of the allocation is unknown
+    void instrumentAllocation(AllocType, Value*, Value* size, Instruction*);
     void instrumentGlobals(Module&);
     void instrumentFunction(Function&);
+    void collectLocalAllocas(Function&);
     void instrumentFunctionParams(Function&);
     void instrumentMain(Function&);
     void instrumentEntry(Function&);
@@ -63,8 +90,10 @@ private:
     void instrumentMalloc(CallSite cs);
 
 public:
-    Instrumenter(DynamicHooks& d, const IDAssigner& i, LLVMContext& c)
-        : hooks(d), idMap(i), context(c) {}
+    Instrumenter(DynamicHooks& d, const IDAssigner& i, LLVMContext& c,
+                 const DataLayout& l, bool s)
+        : hooks(d), idMap(i), context(c), dataLayout(l), skipLocalAllocas(s) {
+    }
 
     void instrument(Module&);
 };
@@ -80,29 +109,40 @@ void Instrumenter::instrumentPointer(Value* val, Instruction* pos) {
 }
 
 void Instrumenter::instrumentAllocation(AllocType allocType, Value* ptr,
-                                        Instruction* pos) {
+                                        Value* size, Instruction* pos) {
     assert(ptr != nullptr && pos != nullptr && ptr->getType()->isPointerTy());
+    assert(size != nullptr && size->getType() == getLongType());
 
     auto allocTypeArg = ConstantInt::get(getCharType(), allocType);
     auto ptrId = getID(*ptr);
     if (ptr->getType() != getCharPtrType())
         ptr = new BitCastInst(ptr, getCharPtrType(), "alloc_ptr", pos);
     auto idArg = ConstantInt::get(getIntType(), ptrId);
-    CallInst::Create(hooks.getAllocHook(), {allocTypeArg, idArg, ptr}, "", pos);
+    CallInst::Create(hooks.getAllocHook(), {allocTypeArg, idArg, ptr, size},
+                     "", pos);
 }
 
 void Instrumenter::instrumentGlobals(Module& module) {
     auto bb = BasicBlock::Create(context, "entry", hooks.getGlobalHook());
     auto retInst = ReturnInst::Create(context, bb);
 
+    // Every module brings its own global hook. Whichever one runs first sets
+    // up the log file; HookInit() ignores the rest of the calls.
+    CallInst::Create(hooks.getInitHook(), "", retInst);
+
     // Global values
     for (auto& global : module.globals()) {
+        // Intrinsic globals such as llvm.global_ctors have no address
+        if (global.getName().startswith("llvm."))
+            continue;
+
         // Prevent global variables from sharing the same address, because it
         // breaks the assumption that global variables do not alias.
         if (global.hasAtLeastLocalUnnamedAddr())
             global.setUnnamedAddr(GlobalValue::UnnamedAddr::None);
 
-        instrumentAllocation(AllocType::Global, &global, retInst);
+        instrumentAllocation(AllocType::Global, &global,
+                             getTypeSize(global.getValueType()), retInst);
     }
 
     // Functions
@@ -115,8 +155,11 @@ void Instrumenter::instrumentGlobals(Module& module) {
         if (f.hasAtLeastLocalUnnamedAddr())
             f.setUnnamedAddr(GlobalValue::UnnamedAddr::None);
 
-        instrumentAllocation(AllocType::Global, &f, retInst);
+        // Functions are not objects that pointers point into
+        instrumentAllocation(AllocType::Global, &f, getUnknownSize(), retInst);
     }
+
+    appendToGlobalCtors(module, hooks.getGlobalHook(), globalHookPriority);
 }
 
 void Instrumenter::instrumentFunctionParams(Function& f) {
@@ -124,7 +167,9 @@ void Instrumenter::instrumentFunctionParams(Function& f) {
     for (auto& arg : f.args()) {
         if (arg.getType()->isPointerTy()) {
             if (arg.hasByValAttr()) {
-                instrumentAllocation(AllocType::Stack, &arg, &*entry);
+                auto size =
+                    getTypeSize(arg.getType()->getPointerElementType());
+                instrumentAllocation(AllocType::Stack, &arg, size, &*entry);
             }
 
             instrumentPointer(&arg, &*entry);
@@ -147,8 +192,28 @@ void Instrumenter::instrumentExit(Instruction& inst) {
 }
 
 void Instrumenter::instrumentAlloca(AllocaInst& allocInst) {
+    if (localAllocas.count(&allocInst))
+        return;
+
     auto pos = nextInsertionPos(allocInst);
-    instrumentAllocation(AllocType::Stack, &allocInst, &*pos);
+    auto size = getTypeSize(allocInst.getAllocatedType());
+    if (allocInst.isArrayAllocation())
+        size = BinaryOperator::CreateMul(
+            size, castToLong(allocInst.getArraySize(), &*pos), "alloc_size",
+            &*pos);
+    instrumentAllocation(AllocType::Stack, &allocInst, size, &*pos);
+}
+
+Value* Instrumenter::getMallocSize(CallSite cs, Instruction* pos) {
+    auto fName = cs.getCalledFunction()->getName();
+    if (fName == "calloc")
+        return BinaryOperator::CreateMul(castToLong(cs.getArgument(0), pos),
+                                         castToLong(cs.getArgument(1), pos),
+                                         "alloc_size", pos);
+    // The size of a strdup() or getline() buffer is not an argument
+    if (fName == "strdup" || fName == "getline")
+        return getUnknownSize();
+    return castToLong(cs.getArgument(0), pos);
 }
 
 void Instrumenter::instrumentMalloc(CallSite cs) {
@@ -156,7 +221,8 @@ void Instrumenter::instrumentMalloc(CallSite cs) {
     assert(!cs.isInvoke() && "Not supported yet");
 
     auto pos = nextInsertionPos(*cs.getInstruction());
-    instrumentAllocation(AllocType::Heap, cs.getInstruction(), &*pos);
+    instrumentAllocation(AllocType::Heap, cs.getInstruction(),
+                         getMallocSize(cs, &*pos), &*pos);
 }
 
 void Instrumenter::instrumentCall(CallSite cs) {
@@ -213,9 +279,9 @@ void Instrumenter::instrumentInst(Instruction& inst) {
 void Instrumenter::instrumentMain(Function& mainFunc) {
     assert(mainFunc.getName() == "main");
 
+    // HookInit() and the global hook have already been run by the module
+    // constructor at this point
     auto pos = mainFunc.begin()->getFirstInsertionPt();
-    CallInst::Create(hooks.getInitHook(), "", &*pos);
-    CallInst::Create(hooks.getGlobalHook(), "", &*pos);
 
     if (mainFunc.arg_size() > 0) {
         assert(mainFunc.arg_size() >= 2);
@@ -244,6 +310,22 @@ void Instrumenter::instrumentMain(Function& mainFunc) {
     CallInst::Create(hooks.getEnterHook(), {idArg}, "", &*pos);
 }
 
+// An alloca whose address never escapes can only be aliased by itself and by
+// pointers trivially derived from it, which any alias analysis can figure out
+// statically. Logging its allocation is a waste of log space. This has to be
+// decided before any hook is inserted, since the hooks take the address.
+void Instrumenter::collectLocalAllocas(Function& f) {
+    localAllocas.clear();
+    if (!skipLocalAllocas)
+        return;
+
+    for (auto& bb : f)
+        for (auto& inst : bb)
+            if (auto allocInst = dyn_cast<AllocaInst>(&inst))
+                if (!PointerMayBeCaptured(allocInst, true, true))
+                    localAllocas.insert(allocInst);
+}
+
 void Instrumenter::instrumentFunction(Function& f) {
     if (f.isDeclaration())
         return;
@@ -251,6 +333,8 @@ void Instrumenter::instrumentFunction(Function& f) {
     if (hooks.isHook(f))
         return;
 
+    collectLocalAllocas(f);
+
     for (auto& bb : f)
         for (auto& inst : bb)
             instrumentInst(inst);
@@ -275,9 +359,11 @@ void MemoryInstrument::runOnModule(Module& module) {
     // Check unsupported features in the input IR and issue warnings accordingly
     FeatureCheck().runOnModule(module);
 
-    IDAssigner idMap(module);
+    IDAssigner idMap(module, moduleID);
     DynamicHooks hooks(module);
 
-    Instrumenter(hooks, idMap, module.getContext()).instrument(module);
+    Instrumenter(hooks, idMap, module.getContext(), module.getDataLayout(),
+                 skipLocalAllocas)
+        .instrument(module);
 }
 }
@@ -0,0 +1,206 @@
+#include "Dynamic/Log/ColumnarLog.h"
+
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dynamic
+{
+
+static const char columnarLogMagic[8] = { 'N', 'G', 'C', 'O', 'L', 'L', 'O', 'G' };
+static constexpr std::uint32_t columnarLogVersion = 2;
+
+static std::uint64_t alignColumn(std::uint64_t offset)
+{
+	return (offset + 63) & ~std::uint64_t(63);
+}
+
+void ColumnarLogWriter::convert(const MappedLogReader& reader, const char* outFileName)
+{
+	// First pass: size the columns. Only the type tags need to be looked at.
+	std::uint64_t numRecords = 0, numFrames = 0;
+	for (auto pos = reader.data(), end = pos + reader.size(); pos < end; ++numRecords)
+	{
+		auto recSize = getEncodedRecordSize(*pos);
+		if (static_cast<std::size_t>(end - pos) < recSize)
+			break;
+		if (*pos == TEnterRec)
+			++numFrames;
+		pos += recSize;
+	}
+
+	ColumnarLogHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, columnarLogMagic, sizeof(header.magic));
+	header.version = columnarLogVersion;
+	header.numRecords = numRecords;
+	header.numFrames = numFrames;
+	header.typeOffset = alignColumn(sizeof(header));
+	header.allocTypeOffset = alignColumn(header.typeOffset + numRecords * sizeof(std::uint8_t));
+	header.idOffset = alignColumn(header.allocTypeOffset + numRecords * sizeof(std::uint8_t));
+	header.addressOffset = alignColumn(header.idOffset + numRecords * sizeof(std::uint32_t));
+	header.frameBeginOffset = alignColumn(header.addressOffset + numRecords * sizeof(std::uint64_t));
+	header.frameEndOffset = alignColumn(header.frameBeginOffset + numFrames * sizeof(std::uint64_t));
+	header.sizeOffset = alignColumn(header.frameEndOffset + numFrames * sizeof(std::uint64_t));
+	auto fileSize = header.sizeOffset + numRecords * sizeof(std::uint64_t);
+
+	auto fd = ::open(outFileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1 || ::ftruncate(fd, fileSize) == -1)
+	{
+		std::cerr << "Create output file " << outFileName << " failed\n";
+		std::exit(-1);
+	}
+	auto mapping = static_cast<char*>(::mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+	if (mapping == MAP_FAILED)
+	{
+		std::cerr << "Map output file " << outFileName << " failed\n";
+		std::exit(-1);
+	}
+	::close(fd);
+
+	std::memcpy(mapping, &header, sizeof(header));
+	auto types = reinterpret_cast<std::uint8_t*>(mapping + header.typeOffset);
+	auto allocTypes = reinterpret_cast<std::uint8_t*>(mapping + header.allocTypeOffset);
+	auto ids = reinterpret_cast<std::uint32_t*>(mapping + header.idOffset);
+	auto addresses = reinterpret_cast<std::uint64_t*>(mapping + header.addressOffset);
+	auto frameBegins = reinterpret_cast<std::uint64_t*>(mapping + header.frameBeginOffset);
+	auto frameEnds = reinterpret_cast<std::uint64_t*>(mapping + header.frameEndOffset);
+	auto sizes = reinterpret_cast<std::uint64_t*>(mapping + header.sizeOffset);
+
+	// Second pass: fill the columns. Frames still open on the stack of their
+	// thread get their ends filled in when their ExitRecords show up.
+	std::unordered_map<unsigned, std::vector<std::uint64_t>> threadFrames;
+	auto openFrames = &threadFrames[0];
+	std::uint64_t i = 0, numFramesSeen = 0;
+	for (auto itr = reader.begin(), ite = reader.end(); itr != ite; ++itr, ++i)
+	{
+		auto const& rec = *itr;
+		types[i] = rec.type;
+		allocTypes[i] = 0;
+		addresses[i] = 0;
+		sizes[i] = 0;
+		switch (rec.type)
+		{
+			case TAllocRec:
+				allocTypes[i] = rec.allocRecord.type;
+				ids[i] = rec.allocRecord.id;
+				addresses[i] = reinterpret_cast<std::uintptr_t>(rec.allocRecord.address);
+				sizes[i] = rec.allocRecord.size;
+				break;
+			case TPointerRec:
+				ids[i] = rec.ptrRecord.id;
+				addresses[i] = reinterpret_cast<std::uintptr_t>(rec.ptrRecord.address);
+				break;
+			case TEnterRec:
+				ids[i] = rec.enterRecord.id;
+				frameBegins[numFramesSeen] = i;
+				frameEnds[numFramesSeen] = numRecords;
+				openFrames->push_back(numFramesSeen++);
+				break;
+			case TExitRec:
+				ids[i] = rec.exitRecord.id;
+				if (openFrames->empty() || ids[frameBegins[openFrames->back()]] != rec.exitRecord.id)
+				{
+					std::cerr << "Function entry/exit do not match. Log file must be broken.\n";
+					std::exit(-1);
+				}
+				frameEnds[openFrames->back()] = i;
+				openFrames->pop_back();
+				break;
+			case TCallRec:
+				ids[i] = rec.callRecord.id;
+				break;
+			case TThreadRec:
+				ids[i] = rec.threadRecord.id;
+				openFrames = &threadFrames[rec.threadRecord.id];
+				break;
+			case TSizedAllocRec:
+				// Decoded as a TAllocRec
+				break;
+		}
+	}
+
+	::munmap(mapping, fileSize);
+}
+
+ColumnarLog::ColumnarLog(const char* fileName): mapping(nullptr), mappingSize(0), header(nullptr)
+{
+	auto fd = ::open(fileName, O_RDONLY);
+	struct stat fileStat;
+	if (fd == -1 || ::fstat(fd, &fileStat) == -1)
+	{
+		std::cerr << "Open columnar log file " << fileName << " failed\n";
+		std::exit(-1);
+	}
+
+	mappingSize = fileStat.st_size;
+	if (mappingSize < sizeof(ColumnarLogHeader))
+	{
+		std::cerr << fileName << " is not a columnar log file\n";
+		std::exit(-1);
+	}
+	mapping = ::mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapping == MAP_FAILED)
+	{
+		std::cerr << "Map columnar log file " << fileName << " failed\n";
+		std::exit(-1);
+	}
+	::close(fd);
+
+	header = static_cast<const ColumnarLogHeader*>(mapping);
+	if (std::memcmp(header->magic, columnarLogMagic, sizeof(columnarLogMagic)) != 0 || header->version != columnarLogVersion || header->sizeOffset + header->numRecords * sizeof(std::uint64_t) > mappingSize)
+	{
+		std::cerr << fileName << " is not a columnar log file of version " << columnarLogVersion << "\n";
+		std::exit(-1);
+	}
+}
+
+ColumnarLog::~ColumnarLog()
+{
+	::munmap(mapping, mappingSize);
+}
+
+LogRecord ColumnarLog::getRecord(std::uint64_t i) const
+{
+	LogRecord rec;
+	rec.type = static_cast<LogRecordType>(types()[i]);
+	auto id = ids()[i];
+	auto address = reinterpret_cast<void*>(static_cast<std::uintptr_t>(addresses()[i]));
+	switch (rec.type)
+	{
+		case TAllocRec:
+			rec.allocRecord.type = allocTypes()[i];
+			rec.allocRecord.id = id;
+			rec.allocRecord.address = address;
+			rec.allocRecord.size = sizes()[i];
+			break;
+		case TPointerRec:
+			rec.ptrRecord.id = id;
+			rec.ptrRecord.address = address;
+			break;
+		case TEnterRec:
+			rec.enterRecord.id = id;
+			break;
+		case TExitRec:
+			rec.exitRecord.id = id;
+			break;
+		case TCallRec:
+			rec.callRecord.id = id;
+			break;
+		case TThreadRec:
+			rec.threadRecord.id = id;
+			break;
+		case TSizedAllocRec:
+			// Stored as a TAllocRec
+			break;
+	}
+	return rec;
+}
+
+}
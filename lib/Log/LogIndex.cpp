@@ -0,0 +1,213 @@
+#include "Dynamic/Instrument/AllocType.h"
+#include "Dynamic/Log/LogIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace dynamic
+{
+
+static const char logIndexMagic[8] = { 'N', 'G', 'L', 'O', 'G', 'I', 'D', 'X' };
+static constexpr std::uint32_t logIndexVersion = 2;
+
+namespace
+{
+
+struct LogIndexHeader
+{
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t numThreads;
+	std::uint64_t logSize;
+	std::uint64_t numFunctions;
+	std::uint64_t numFrames;
+	std::uint64_t numGlobals;
+};
+
+struct FrameInfo
+{
+	std::uint32_t func;
+	LogIndex::FrameEntry entry;
+};
+
+}
+
+LogIndex LogIndex::build(const MappedLogReader& reader)
+{
+	LogIndex index;
+	index.logSize = reader.size();
+
+	std::vector<FrameInfo> frameInfos;
+	// Frames nest within their own thread only
+	std::unordered_map<unsigned, std::vector<FrameInfo>> threadFrames;
+	auto openFrames = &threadFrames[0];
+	for (auto itr = reader.begin(), ite = reader.end(); itr != ite; ++itr)
+	{
+		auto offset = static_cast<std::uint64_t>(itr.getPosition() - reader.data());
+		switch (itr->type)
+		{
+			case TAllocRec:
+				if (itr->allocRecord.type == AllocType::Global)
+					index.globalOffsets.push_back(offset);
+				break;
+			case TEnterRec:
+				openFrames->push_back(FrameInfo{ itr->enterRecord.id, { offset, index.logSize } });
+				break;
+			case TExitRec:
+				if (openFrames->empty() || openFrames->back().func != itr->exitRecord.id)
+				{
+					std::cerr << "Function entry/exit do not match. Log file must be broken.\n";
+					std::exit(-1);
+				}
+				openFrames->back().entry.exitOffset = offset;
+				frameInfos.push_back(openFrames->back());
+				openFrames->pop_back();
+				break;
+			case TThreadRec:
+				openFrames = &threadFrames[itr->threadRecord.id];
+				break;
+			default:
+				break;
+		}
+	}
+	for (auto const& mapping: threadFrames)
+		frameInfos.insert(frameInfos.end(), mapping.second.begin(), mapping.second.end());
+	index.numThreads = threadFrames.size();
+
+	std::sort(frameInfos.begin(), frameInfos.end(), [] (const FrameInfo& lhs, const FrameInfo& rhs)
+	{
+		return lhs.func < rhs.func || (lhs.func == rhs.func && lhs.entry.enterOffset < rhs.entry.enterOffset);
+	});
+
+	index.frames.reserve(frameInfos.size());
+	for (auto const& info: frameInfos)
+	{
+		if (index.functions.empty() || index.functions.back().id != info.func)
+			index.functions.push_back(FunctionEntry{ info.func, 0, index.frames.size(), 0 });
+		++index.functions.back().numFrames;
+		index.frames.push_back(info.entry);
+	}
+
+	return index;
+}
+
+template <typename T>
+static void readArray(std::istream& is, std::vector<T>& vec, std::uint64_t size)
+{
+	vec.resize(size);
+	is.read(reinterpret_cast<char*>(vec.data()), size * sizeof(T));
+}
+
+template <typename T>
+static void writeArray(std::ostream& os, const std::vector<T>& vec)
+{
+	os.write(reinterpret_cast<const char*>(vec.data()), vec.size() * sizeof(T));
+}
+
+LogIndex LogIndex::readFromFile(const char* fileName)
+{
+	std::ifstream ifs(fileName, std::ios::in | std::ios::binary);
+	if (!ifs.is_open())
+	{
+		std::cerr << "Open log index file " << fileName << " failed\n";
+		std::exit(-1);
+	}
+
+	LogIndexHeader header;
+	ifs.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!ifs.good() || std::memcmp(header.magic, logIndexMagic, sizeof(logIndexMagic)) != 0 || header.version != logIndexVersion)
+	{
+		std::cerr << fileName << " is not a log index file of version " << logIndexVersion << "\n";
+		std::exit(-1);
+	}
+
+	LogIndex index;
+	index.logSize = header.logSize;
+	index.numThreads = header.numThreads;
+	readArray(ifs, index.functions, header.numFunctions);
+	readArray(ifs, index.frames, header.numFrames);
+	readArray(ifs, index.globalOffsets, header.numGlobals);
+	if (!ifs.good())
+	{
+		std::cerr << "Log index file " << fileName << " is truncated\n";
+		std::exit(-1);
+	}
+	return index;
+}
+
+void LogIndex::writeToFile(const char* fileName) const
+{
+	std::ofstream ofs(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+
+	LogIndexHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, logIndexMagic, sizeof(header.magic));
+	header.version = logIndexVersion;
+	header.numThreads = numThreads;
+	header.logSize = logSize;
+	header.numFunctions = functions.size();
+	header.numFrames = frames.size();
+	header.numGlobals = globalOffsets.size();
+
+	ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	writeArray(ofs, functions);
+	writeArray(ofs, frames);
+	writeArray(ofs, globalOffsets);
+	if (!ofs.good())
+	{
+		std::cerr << "Write log index file " << fileName << " failed\n";
+		std::exit(-1);
+	}
+}
+
+std::pair<const LogIndex::FrameEntry*, const LogIndex::FrameEntry*> LogIndex::getFrames(std::uint32_t id) const
+{
+	auto itr = std::lower_bound(functions.begin(), functions.end(), id, [] (const FunctionEntry& entry, std::uint32_t id)
+	{
+		return entry.id < id;
+	});
+	if (itr == functions.end() || itr->id != id)
+		return std::make_pair(nullptr, nullptr);
+
+	auto begin = frames.data() + itr->firstFrame;
+	return std::make_pair(begin, begin + itr->numFrames);
+}
+
+std::vector<LogIndex::OpenFrame> LogIndex::getOpenFrames(std::uint64_t offset) const
+{
+	std::vector<OpenFrame> openFrames;
+	for (auto const& function: functions)
+	{
+		for (auto i = function.firstFrame, e = function.firstFrame + function.numFrames; i < e; ++i)
+		{
+			auto const& frame = frames[i];
+			if (frame.enterOffset >= offset)
+				break;
+			if (frame.exitOffset >= offset)
+				openFrames.push_back(OpenFrame{ function.id, frame });
+		}
+	}
+
+	std::sort(openFrames.begin(), openFrames.end(), [] (const OpenFrame& lhs, const OpenFrame& rhs)
+	{
+		return lhs.entry.enterOffset < rhs.entry.enterOffset;
+	});
+	return openFrames;
+}
+
+std::uint64_t LogIndex::getExitOffset(std::uint32_t id, std::uint64_t enterOffset) const
+{
+	auto range = getFrames(id);
+	auto itr = std::lower_bound(range.first, range.second, enterOffset, [] (const FrameEntry& entry, std::uint64_t offset)
+	{
+		return entry.enterOffset < offset;
+	});
+	if (itr == range.second || itr->enterOffset != enterOffset)
+		return logSize;
+	return itr->exitOffset;
+}
+
+}
@@ -1,52 +1,181 @@
 #include "Dynamic/Instrument/AllocType.h"
 #include "Dynamic/Log/LogPrinter.h"
 
+#include <cstring>
 #include <iostream>
 
 namespace dynamic
 {
 
-LogPrinter::LogPrinter(const char* fileName, std::ostream& o): LogProcessor(fileName), os(o) {}
+// Flush the buffer once less than a line's worth of space is left
+static constexpr std::size_t bufferSize = 1 << 16;
+static constexpr std::size_t maxLineSize = 128;
+
+LogPrinter::LogPrinter(const char* fileName, std::ostream& o, LogFilter f): LogProcessor(fileName), os(o), filter(std::move(f)), numRecordsSeen(0), buffer(bufferSize), bufferUsed(0) {}
+
+LogPrinter::~LogPrinter()
+{
+	flush();
+}
+
+void LogPrinter::flush()
+{
+	os.write(buffer.data(), bufferUsed);
+	bufferUsed = 0;
+}
+
+void LogPrinter::append(const char* str)
+{
+	auto len = std::strlen(str);
+	std::memcpy(buffer.data() + bufferUsed, str, len);
+	bufferUsed += len;
+}
+
+void LogPrinter::appendDecimal(std::uint64_t num)
+{
+	char digits[24];
+	auto pos = digits + sizeof(digits);
+	do
+	{
+		*--pos = '0' + num % 10;
+		num /= 10;
+	} while (num != 0);
+
+	auto len = digits + sizeof(digits) - pos;
+	std::memcpy(buffer.data() + bufferUsed, pos, len);
+	bufferUsed += len;
+}
+
+// Same format as printing a void* to an ostream: "0" for a null pointer and
+// lower-case hex with a "0x" prefix otherwise
+void LogPrinter::appendAddress(const void* addr)
+{
+	auto num = reinterpret_cast<std::uintptr_t>(addr);
+	if (num == 0)
+	{
+		buffer[bufferUsed++] = '0';
+		return;
+	}
+
+	char digits[2 * sizeof(std::uintptr_t)];
+	auto pos = digits + sizeof(digits);
+	while (num != 0)
+	{
+		*--pos = "0123456789abcdef"[num & 0xf];
+		num >>= 4;
+	}
+
+	append("0x");
+	auto len = digits + sizeof(digits) - pos;
+	std::memcpy(buffer.data() + bufferUsed, pos, len);
+	bufferUsed += len;
+}
+
+void LogPrinter::endLine()
+{
+	buffer[bufferUsed++] = '\n';
+	if (bufferUsed + maxLineSize > buffer.size())
+		flush();
+}
+
+void LogPrinter::visitBatch(const LogRecord* begin, const LogRecord* end)
+{
+	// Batches outside of the index window need not be looked at
+	std::uint64_t batchSize = end - begin;
+	if (!filter.overlapsIndexWindow(numRecordsSeen, numRecordsSeen + batchSize))
+	{
+		numRecordsSeen += batchSize;
+		return;
+	}
+	LogProcessor::visitBatch(begin, end);
+}
 
 void LogPrinter::visitAllocRecord(const AllocRecord& allocRecord)
 {
-	os << "[ALLOC] ";
+	if (!filter.accepts(numRecordsSeen++, TAllocRec, allocRecord.id, allocRecord.address))
+		return;
+
+	append("[ALLOC] ");
 	switch (allocRecord.type)
 	{
 		case AllocType::Global:
-			os << "Global ";
+			append("Global ");
 			break;
 		case AllocType::Stack:
-			os << "Stack ";
+			append("Stack ");
 			break;
 		case AllocType::Heap:
-			os << "Heap ";
+			append("Heap ");
 			break;
 		default:
+			flush();
+			os.flush();
 			std::cerr << "Illegal alloc type. Log file must be broken\n";
 			std::exit(-1);
 	}
-	os << "Ptr# " << allocRecord.id << " = " << allocRecord.address << '\n';
+	append("Ptr# ");
+	appendDecimal(allocRecord.id);
+	append(" = ");
+	appendAddress(allocRecord.address);
+	if (allocRecord.size != 0)
+	{
+		append(", ");
+		appendDecimal(allocRecord.size);
+		append(" bytes");
+	}
+	endLine();
 }
 
 void LogPrinter::visitPointerRecord(const PointerRecord& ptrRecord)
 {
-	os << "[POINTER] Ptr# " << ptrRecord.id << " = " << ptrRecord.address << '\n';
+	if (!filter.accepts(numRecordsSeen++, TPointerRec, ptrRecord.id, ptrRecord.address))
+		return;
+
+	append("[POINTER] Ptr# ");
+	appendDecimal(ptrRecord.id);
+	append(" = ");
+	appendAddress(ptrRecord.address);
+	endLine();
 }
 
 void LogPrinter::visitEnterRecord(const EnterRecord& enterRecord)
 {
-	os << "[ENTER] Function# " << enterRecord.id << '\n';
+	if (!filter.accepts(numRecordsSeen++, TEnterRec, enterRecord.id))
+		return;
+
+	append("[ENTER] Function# ");
+	appendDecimal(enterRecord.id);
+	endLine();
 }
 
 void LogPrinter::visitExitRecord(const ExitRecord& exitRecord)
 {
-	os << "[EXIT] Function# " << exitRecord.id << '\n';
+	if (!filter.accepts(numRecordsSeen++, TExitRec, exitRecord.id))
+		return;
+
+	append("[EXIT] Function# ");
+	appendDecimal(exitRecord.id);
+	endLine();
 }
 
 void LogPrinter::visitCallRecord(const CallRecord& callRecord)
 {
-	os << "[CALL] Inst# " << callRecord.id << '\n';
+	if (!filter.accepts(numRecordsSeen++, TCallRec, callRecord.id))
+		return;
+
+	append("[CALL] Inst# ");
+	appendDecimal(callRecord.id);
+	endLine();
+}
+
+void LogPrinter::visitThreadRecord(const ThreadRecord& threadRecord)
+{
+	if (!filter.accepts(numRecordsSeen++, TThreadRec, threadRecord.id))
+		return;
+
+	append("[THREAD] Thread# ");
+	appendDecimal(threadRecord.id);
+	endLine();
 }
 
 }
@@ -1,8 +1,14 @@
 #include "Dynamic/Log/LogReader.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace dynamic
 {
 
@@ -27,6 +33,14 @@ static std::experimental::optional<LogRecord> readRecord(std::istream& is)
 			succ &= readData(is, &rec.allocRecord.type);
 			succ &= readData(is, &rec.allocRecord.id);
 			succ &= readData(is, &rec.allocRecord.address);
+			rec.allocRecord.size = 0;
+			break;
+		case TSizedAllocRec:
+			succ &= readData(is, &rec.allocRecord.type);
+			succ &= readData(is, &rec.allocRecord.id);
+			succ &= readData(is, &rec.allocRecord.address);
+			succ &= readData(is, &rec.allocRecord.size);
+			type = TAllocRec;
 			break;
 		case TPointerRec:
 			succ &= readData(is, &rec.ptrRecord.id);
@@ -41,6 +55,9 @@ static std::experimental::optional<LogRecord> readRecord(std::istream& is)
 		case TCallRec:
 			succ &= readData(is, &rec.callRecord.id);
 			break;
+		case TThreadRec:
+			succ &= readData(is, &rec.threadRecord.id);
+			break;
 		default:
 		{
 			std::cerr << static_cast<unsigned>(rec.type) << std::endl;
@@ -93,4 +110,52 @@ std::experimental::optional<LogRecord> LazyLogReader::readLogRecord()
 	return readRecord(ifs);
 }
 
-}
\ No newline at end of file
+MappedLogReader::MappedLogReader(const char* fileName, bool useHugePages): mapping(nullptr), mappingSize(0), logBegin(nullptr), logEnd(nullptr)
+{
+	auto fd = ::open(fileName, O_RDONLY);
+	struct stat fileStat;
+	if (fd == -1 || ::fstat(fd, &fileStat) == -1)
+	{
+		std::cerr << "Open log file " << fileName << " failed\n";
+		std::exit(-1);
+	}
+
+	mappingSize = fileStat.st_size;
+	if (mappingSize > 0)
+	{
+		mapping = ::mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED)
+		{
+			std::cerr << "Map log file " << fileName << " failed\n";
+			std::exit(-1);
+		}
+
+		// Both are only hints, so failures are ignored
+		::madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+		if (useHugePages)
+			::madvise(mapping, mappingSize, MADV_HUGEPAGE);
+#endif
+
+		logBegin = static_cast<const char*>(mapping);
+		logEnd = logBegin + mappingSize;
+	}
+	::close(fd);
+}
+
+void MappedLogReader::dropPagesBefore(std::size_t offset)
+{
+	auto pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+	auto length = std::min(offset, mappingSize) / pageSize * pageSize;
+	// Only a hint, so failures are ignored
+	if (length > 0)
+		::madvise(mapping, length, MADV_DONTNEED);
+}
+
+MappedLogReader::~MappedLogReader()
+{
+	if (mapping != nullptr)
+		::munmap(mapping, mappingSize);
+}
+
+}
@@ -0,0 +1,149 @@
+#include "Dynamic/Log/ParallelLogReader.h"
+
+#include <algorithm>
+
+namespace dynamic
+{
+
+LogSplitter::LogSplitter(const MappedLogReader& reader, std::size_t cs): splitPos(reader.data()), logEnd(reader.data() + reader.size()), chunkSize(cs), splitDone(false)
+{
+}
+
+bool LogSplitter::next(const char*& begin, const char*& end)
+{
+	if (splitDone)
+		return false;
+
+	begin = splitPos;
+	auto limit = static_cast<std::size_t>(logEnd - splitPos) > chunkSize ? splitPos + chunkSize : logEnd;
+	auto pos = splitPos;
+	while (pos < limit)
+	{
+		auto recSize = getEncodedRecordSize(*pos);
+		// A record cut off at the end of the log ends the log
+		if (static_cast<std::size_t>(logEnd - pos) < recSize)
+		{
+			splitDone = true;
+			break;
+		}
+		pos += recSize;
+	}
+	if (pos == logEnd)
+		splitDone = true;
+
+	end = splitPos = pos;
+	return begin != end;
+}
+
+ParallelLogReader::ParallelLogReader(const MappedLogReader& reader, unsigned numThreads, std::size_t chunkSize): splitter(reader, chunkSize), numChunksSplit(0), nextChunkToConsume(0), holdsSlot(false), stopped(false)
+{
+	numThreads = std::max(numThreads, 1u);
+	slots.resize(numThreads * 2);
+	for (auto& slot: slots)
+		slot.ready = false;
+
+	workers.reserve(numThreads);
+	for (auto i = 0u; i < numThreads; ++i)
+		workers.emplace_back([this] { runWorker(); });
+}
+
+ParallelLogReader::~ParallelLogReader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopped = true;
+	}
+	slotFreed.notify_all();
+	for (auto& worker: workers)
+		worker.join();
+}
+
+void ParallelLogReader::runWorker()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopped)
+	{
+		const char *begin, *end;
+		if (!splitter.next(begin, end))
+			break;
+		auto chunkIndex = numChunksSplit++;
+		auto& slot = slots[chunkIndex % slots.size()];
+
+		// Wait for the consumer to be done with the chunk that used this slot
+		// before
+		slotFreed.wait(lock, [&] { return stopped || nextChunkToConsume + slots.size() > chunkIndex; });
+		if (stopped)
+			break;
+
+		lock.unlock();
+		slot.batch.clear();
+		auto pos = begin;
+		while (pos != end)
+		{
+			slot.batch.emplace_back();
+			pos = decodeLogRecord(pos, end, slot.batch.back());
+		}
+		lock.lock();
+
+		slot.chunkIndex = chunkIndex;
+		slot.ready = true;
+		slotReady.notify_all();
+	}
+
+	// Wake up the consumer in case it is waiting for a chunk that will never
+	// come
+	slotReady.notify_all();
+}
+
+// Must be called with the mutex held
+void ParallelLogReader::releaseSlot()
+{
+	if (!holdsSlot)
+		return;
+	slots[nextChunkToConsume % slots.size()].ready = false;
+	++nextChunkToConsume;
+	holdsSlot = false;
+	slotFreed.notify_all();
+}
+
+const ParallelLogReader::Batch* ParallelLogReader::nextBatch()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	releaseSlot();
+
+	auto& slot = slots[nextChunkToConsume % slots.size()];
+	slotReady.wait(lock, [&] { return (slot.ready && slot.chunkIndex == nextChunkToConsume) || (splitter.done() && nextChunkToConsume >= numChunksSplit); });
+	if (!slot.ready || slot.chunkIndex != nextChunkToConsume)
+		return nullptr;
+
+	holdsSlot = true;
+	return &slot.batch;
+}
+
+void ParallelLogReader::forEachChunk(const MappedLogReader& reader, unsigned numThreads, const std::function<void(const char*, const char*)>& processChunk, std::size_t chunkSize)
+{
+	LogSplitter splitter(reader, chunkSize);
+	std::mutex mutex;
+	auto runWorker = [&]
+	{
+		while (true)
+		{
+			const char *begin, *end;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (!splitter.next(begin, end))
+					return;
+			}
+			processChunk(begin, end);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (auto i = 1u; i < numThreads; ++i)
+		workers.emplace_back(runWorker);
+	runWorker();
+	for (auto& worker: workers)
+		worker.join();
+}
+
+}
@@ -0,0 +1,109 @@
+#include "Dynamic/Support/ThreadPool.h"
+
+#include <algorithm>
+
+namespace dynamic {
+
+ThreadPool::ThreadPool(unsigned numThreads, std::size_t m)
+    : numQueued(0), numPending(0), maxPending(std::max<std::size_t>(m, 1)),
+      nextQueue(0), stopping(false) {
+    numThreads = std::max(numThreads, 1u);
+    for (auto i = 0u; i < numThreads; ++i)
+        queues.emplace_back(new TaskQueue());
+    for (auto i = 0u; i < numThreads; ++i)
+        workers.emplace_back([this, i] { runWorker(i); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        taskDone.wait(lock, [this] { return numPending == 0; });
+        stopping = true;
+    }
+    taskQueued.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    unsigned queueIndex;
+    {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        taskDone.wait(lock, [this] { return numPending < maxPending; });
+        ++numPending;
+        queueIndex = nextQueue++ % queues.size();
+    }
+
+    {
+        auto& queue = *queues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        ++numQueued;
+    }
+    taskQueued.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    taskDone.wait(lock, [this] { return numPending == 0; });
+    if (taskError) {
+        auto error = taskError;
+        taskError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+// Take a task out of the worker's own queue, or steal one from the others.
+// The caller has claimed a queued task, so one is bound to be found.
+std::function<void()> ThreadPool::takeTask(unsigned index) {
+    while (true) {
+        for (std::size_t i = 0, e = queues.size(); i < e; ++i) {
+            auto& queue = *queues[(index + i) % e];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+
+            std::function<void()> task;
+            if (i == 0) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+            return task;
+        }
+    }
+}
+
+void ThreadPool::runWorker(unsigned index) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            taskQueued.wait(lock, [this] { return numQueued > 0 || stopping; });
+            if (numQueued == 0)
+                return;
+            --numQueued;
+        }
+
+        auto task = takeTask(index);
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (!taskError)
+                taskError = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            --numPending;
+        }
+        taskDone.notify_all();
+    }
+}
+}
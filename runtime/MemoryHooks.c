@@ -51,9 +51,8 @@ static void writeData(void* data, size_t size)
 		panic("Log write error\n");
 }
 
-static void writeLogRecord(struct LogRecord* rec)
+static void writeRecordFields(struct LogRecord* rec)
 {
-	assert(logFile != NULL && rec != NULL);
 	char type = rec->type;
 	writeData(&type, sizeof(char));
 	switch (rec->type)
@@ -63,6 +62,12 @@ static void writeLogRecord(struct LogRecord* rec)
 			writeData(&rec->allocRecord.id, sizeof(unsigned));
 			writeData(&rec->allocRecord.address, sizeof(void*));
 			break;
+		case TSizedAllocRec:
+			writeData(&rec->allocRecord.type, sizeof(char));
+			writeData(&rec->allocRecord.id, sizeof(unsigned));
+			writeData(&rec->allocRecord.address, sizeof(void*));
+			writeData(&rec->allocRecord.size, sizeof(size_t));
+			break;
 		case TPointerRec:
 			writeData(&rec->ptrRecord.id, sizeof(unsigned));
 			writeData(&rec->ptrRecord.address, sizeof(void*));
@@ -76,11 +81,40 @@ static void writeLogRecord(struct LogRecord* rec)
 		case TCallRec:
 			writeData(&rec->callRecord.id, sizeof(unsigned));
 			break;
+		case TThreadRec:
+			writeData(&rec->threadRecord.id, sizeof(unsigned));
+			break;
 		default:
 			panic("Illegal record type\n");
 	}
 }
 
+// Only touched with the log file locked
+static unsigned numThreads = 0;
+static unsigned lastThread = 0;
+static const unsigned noThreadID = ~0u;
+static __thread unsigned threadID = noThreadID;
+
+static void writeLogRecord(struct LogRecord* rec)
+{
+	assert(logFile != NULL && rec != NULL);
+	// Records of different threads must neither interleave nor lose track of
+	// their thread, so the switch and the record are written as one
+	flockfile(logFile);
+	if (threadID == noThreadID)
+		threadID = numThreads++;
+	if (threadID != lastThread)
+	{
+		struct LogRecord threadRec;
+		threadRec.type = TThreadRec;
+		threadRec.threadRecord.id = threadID;
+		writeRecordFields(&threadRec);
+		lastThread = threadID;
+	}
+	writeRecordFields(rec);
+	funlockfile(logFile);
+}
+
 extern void HookFinalize()
 {
 	assert(logFile != NULL);
@@ -89,6 +123,10 @@ extern void HookFinalize()
 
 extern void HookInit()
 {
+	// Every instrumented module calls HookInit() from its own constructor
+	if (logFile != NULL)
+		return;
+
 	const char* logDirName = "log";
 	const char* logDirEnv = getenv("LOG_DIR");
 	if (logDirEnv != NULL)
@@ -101,18 +139,26 @@ extern void HookInit()
 	atexit(HookFinalize);
 }
 
-extern void HookAlloc(char ty, unsigned id, void* addr)
+// A size of 0 means that the size is unknown, which the shorter TAllocRec says
+extern void HookSizedAlloc(char ty, unsigned id, void* addr, size_t size)
 {
 	struct LogRecord record;
 	memset(&record, 0, sizeof(record));
-	record.type = TAllocRec;
+	record.type = size != 0 ? TSizedAllocRec : TAllocRec;
 	record.allocRecord.type = ty;
 	record.allocRecord.id = id;
 	record.allocRecord.address = addr;
-	//printf("[ALLOC] %d %p\n", ty, addr);
+	record.allocRecord.size = size;
+	//printf("[ALLOC] %d %p %zu\n", ty, addr, size);
 	writeLogRecord(&record);
 }
 
+// Kept for modules instrumented before allocation sizes were logged
+extern void HookAlloc(char ty, unsigned id, void* addr)
+{
+	HookSizedAlloc(ty, id, addr, 0);
+}
+
 extern void HookMain(int argvId, char** argv, int envpId, char** envp)
 {
 	HookAlloc(1, argvId, argv);
@@ -1,53 +1,725 @@
+#include "Dynamic/Analysis/AliasResultFile.h"
 #include "Dynamic/Analysis/DynamicAliasAnalysis.h"
 #include "Dynamic/Instrument/IDAssigner.h"
 
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/Analysis/AssumptionCache.h>
 #include <llvm/Analysis/BasicAliasAnalysis.h>
 #include <llvm/Analysis/CFLAliasAnalysis.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/ScalarEvolutionAliasAnalysis.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TypeBasedAliasAnalysis.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/PassManager.h>
 #include <llvm/IRReader/IRReader.h>
 #include <llvm/Support/CommandLine.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 using namespace dynamic;
 using namespace llvm;
 
 enum class AAType
 {
-    CFLAA
+    BasicAA,
+    CFLAA,
+    SCEVAA,
+    TBAA
 };
 
 cl::opt<std::string> InputFilename(cl::Positional, cl::desc("<bitcode file>"));
-cl::opt<std::string> LogFilename(cl::Positional, cl::desc("<log file>"));
-cl::opt<AAType> AA(cl::Positional, cl::desc("<alias-analysis>"),
-                   cl::values(clEnumValN(AAType::CFLAA, "cfl-aa", "CFL-AA"),
-                              clEnumValEnd));
+cl::opt<std::string> LogFilename(
+    cl::Positional, cl::desc("<log file or alias result file>"));
+cl::list<AAType> AAs(
+    cl::Positional, cl::OneOrMore, cl::desc("<alias-analysis>..."),
+    cl::values(clEnumValN(AAType::BasicAA, "basic-aa", "BasicAA"),
+               clEnumValN(AAType::CFLAA, "cfl-aa", "CFL-AA"),
+               clEnumValN(AAType::SCEVAA, "scev-aa", "SCEV-AA"),
+               clEnumValN(AAType::TBAA, "tbaa", "TBAA"), clEnumValEnd));
+cl::opt<unsigned> ModuleID(
+    "module-id",
+    cl::desc("Module ID the bitcode file was instrumented with"),
+    cl::value_desc("id"), cl::init(0));
+cl::opt<unsigned> NumJobs(
+    "j",
+    cl::desc("Number of functions checked at the same time (0 uses one per "
+             "core)"),
+    cl::value_desc("n"), cl::init(1));
+cl::opt<std::string> CacheFilename(
+    "cache",
+    cl::desc("Reuse the answers of the tested AAs saved in this file by "
+             "earlier runs, and add the new ones to it"),
+    cl::value_desc("filename"));
+cl::opt<bool> Stream(
+    "stream",
+    cl::desc("Check the pairs of each function while the dynamic analysis "
+             "is still running, and print the reports as they are found"));
+
+namespace {
+
+// The DidAlias pairs found by the dynamic analysis, either run on a log or
+// read from a result file. Shared read-only by all workers.
+struct DynamicResults
+{
+    const DynamicAliasAnalysis* dynAA;
+    const AliasResultFile* resultFile;
+};
+
+const char* getAAName(AAType aa) {
+    switch (aa) {
+        case AAType::BasicAA:
+            return "basic-aa";
+        case AAType::CFLAA:
+            return "cfl-aa";
+        case AAType::SCEVAA:
+            return "scev-aa";
+        case AAType::TBAA:
+            return "tbaa";
+    }
+    return "";
+}
+
+// FNV-1a over the contents of the file, or 0 if it cannot be read
+std::uint64_t hashFile(const std::string& fileName) {
+    auto buffer = MemoryBuffer::getFile(fileName);
+    if (!buffer)
+        return 0;
+    std::uint64_t hash = 14695981039346656037ull;
+    for (auto c : (*buffer)->getBuffer()) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// A cache file is a CacheFileHeader followed by its sections. Each section
+// holds the answers for one bitcode file, module ID and alias analysis: a
+// CacheSectionHeader, the name of the alias analysis and the entries.
+const char cacheMagic[8] = {'N', 'G', 'A', 'A', 'Q', 'C', 'C', 'H'};
+constexpr std::uint32_t cacheVersion = 2;
+
+struct CacheFileHeader
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t numSections;
+};
+
+struct CacheSectionHeader
+{
+    std::uint64_t moduleHash;
+    std::uint32_t moduleID;
+    std::uint32_t aaNameSize;
+    std::uint64_t numEntries;
+};
+
+// The pair is packed by AliasPairSet::packPair()
+struct CacheEntry
+{
+    std::uint64_t pair;
+    DynamicPointer func;
+    std::uint32_t result;
+};
+
+// Answers of the tested alias analyses from earlier runs, one table per
+// analysis. A query is identified by the function the analysis ran on and the
+// IDs of the two values asked about. Sections of other modules or alias
+// analyses in the same file are kept as they are.
+class AliasQueryCache
+{
+private:
+    std::uint64_t moduleHash;
+    std::uint32_t moduleID;
+    std::vector<std::string> aaNames;
+    using Key = std::pair<DynamicPointer, std::uint64_t>;
+    std::vector<DenseMap<Key, AliasResult>> results;
+
+    struct Section
+    {
+        CacheSectionHeader header;
+        std::string aaName;
+        std::vector<CacheEntry> entries;
+    };
+    std::vector<Section> otherSections;
+
+public:
+    AliasQueryCache(std::uint64_t hash, unsigned id,
+                    std::vector<std::string> names)
+        : moduleHash(hash), moduleID(id), aaNames(std::move(names)),
+          results(aaNames.size()) {}
+
+    // A missing file is an empty cache. Returns false if the file is not a
+    // cache file.
+    bool readFromFile(const std::string& fileName);
+    // The file is replaced atomically
+    bool writeToFile(const std::string& fileName) const;
+
+    // Safe to call from several threads at once, as long as nothing is
+    // inserted. aa indexes the names the cache was created with.
+    const AliasResult* lookup(unsigned aa, DynamicPointer func,
+                              const AliasPair& pair) const {
+        auto itr = results[aa].find(Key(func, AliasPairSet::packPair(pair)));
+        return itr == results[aa].end() ? nullptr : &itr->second;
+    }
+    void insert(unsigned aa, const CacheEntry& entry) {
+        results[aa][Key(entry.func, entry.pair)] =
+            static_cast<AliasResult>(entry.result);
+    }
+};
+
+template <typename T> bool readValue(std::istream& is, T& value) {
+    is.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return is.good();
+}
+
+bool AliasQueryCache::readFromFile(const std::string& fileName) {
+    std::ifstream ifs(fileName, std::ios::in | std::ios::binary);
+    if (!ifs.is_open())
+        return true;
+
+    CacheFileHeader fileHeader;
+    if (!readValue(ifs, fileHeader) ||
+        std::memcmp(fileHeader.magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+        fileHeader.version != cacheVersion)
+        return false;
 
-void checkAAResult(AAResults& aaResult, const DenseSet<AliasPair>& aliasSet,
-                   const IDAssigner& idMap) {
+    for (auto i = 0u; i < fileHeader.numSections; ++i) {
+        Section section;
+        if (!readValue(ifs, section.header))
+            return false;
+        section.aaName.resize(section.header.aaNameSize);
+        section.entries.resize(section.header.numEntries);
+        ifs.read(&section.aaName[0], section.aaName.size());
+        ifs.read(reinterpret_cast<char*>(section.entries.data()),
+                 section.entries.size() * sizeof(CacheEntry));
+        if (!ifs.good())
+            return false;
+
+        auto aa = std::find(aaNames.begin(), aaNames.end(), section.aaName);
+        if (section.header.moduleHash != moduleHash ||
+            section.header.moduleID != moduleID || aa == aaNames.end()) {
+            otherSections.push_back(std::move(section));
+            continue;
+        }
+        for (auto const& entry : section.entries) {
+            if (entry.result > MustAlias)
+                return false;
+            insert(aa - aaNames.begin(), entry);
+        }
+    }
+    return true;
+}
+
+bool AliasQueryCache::writeToFile(const std::string& fileName) const {
+    auto tmpFileName = fileName + ".tmp";
+    std::ofstream ofs(tmpFileName,
+                      std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open())
+        return false;
+
+    CacheFileHeader fileHeader;
+    std::memset(&fileHeader, 0, sizeof(fileHeader));
+    std::memcpy(fileHeader.magic, cacheMagic, sizeof(fileHeader.magic));
+    fileHeader.version = cacheVersion;
+    fileHeader.numSections = otherSections.size() + aaNames.size();
+    ofs.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+
+    for (auto const& section : otherSections) {
+        ofs.write(reinterpret_cast<const char*>(&section.header),
+                  sizeof(section.header));
+        ofs.write(section.aaName.data(), section.aaName.size());
+        ofs.write(reinterpret_cast<const char*>(section.entries.data()),
+                  section.entries.size() * sizeof(CacheEntry));
+    }
+
+    std::vector<CacheEntry> entries;
+    for (auto aa = 0u; aa < aaNames.size(); ++aa) {
+        entries.clear();
+        for (auto const& mapping : results[aa]) {
+            CacheEntry entry;
+            std::memset(&entry, 0, sizeof(entry));
+            entry.func = mapping.first.first;
+            entry.pair = mapping.first.second;
+            entry.result = mapping.second;
+            entries.push_back(entry);
+        }
+        CacheSectionHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.moduleHash = moduleHash;
+        header.moduleID = moduleID;
+        header.aaNameSize = aaNames[aa].size();
+        header.numEntries = entries.size();
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ofs.write(aaNames[aa].data(), aaNames[aa].size());
+        ofs.write(reinterpret_cast<const char*>(entries.data()),
+                  entries.size() * sizeof(CacheEntry));
+    }
+
+    ofs.close();
+    return ofs.good() &&
+           std::rename(tmpFileName.data(), fileName.data()) == 0;
+}
+
+// What a worker hands back besides its reports, per tested AA
+struct WorkerOutput
+{
+    // Answers to be added to the cache
+    std::vector<std::vector<CacheEntry>> newEntries;
+    std::vector<std::uint64_t> numBugs;
+    std::uint64_t numQueries = 0;
+    std::uint64_t numCachedQueries = 0;
+
+    explicit WorkerOutput(std::size_t numAAs)
+        : newEntries(numAAs), numBugs(numAAs, 0) {}
+};
+
+// Asks one tested alias analysis about the values of one function, unless
+// the cache knows the answer. The analysis only runs on the function once a
+// query misses the cache, so that a function whose queries are all cached
+// costs nothing.
+class FunctionQuerier
+{
+private:
+    Function& function;
+    DynamicPointer funcID;
+    const IDAssigner& idMap;
+    // Index of the tested AA
+    unsigned aa;
+    AAManager& aaManager;
+    FunctionAnalysisManager& funManager;
+    const AliasQueryCache* cache;
+    WorkerOutput& output;
+    std::unique_ptr<AAResults> aaResult;
+
+public:
+    FunctionQuerier(Function& f, DynamicPointer id, const IDAssigner& i,
+                    unsigned a, AAManager& am, FunctionAnalysisManager& fm,
+                    const AliasQueryCache* c, WorkerOutput& o)
+        : function(f), funcID(id), idMap(i), aa(a), aaManager(am),
+          funManager(fm), cache(c), output(o) {}
+
+    AliasResult alias(const MemoryLocation& locA, const MemoryLocation& locB) {
+        ++output.numQueries;
+        auto idA = idMap.getID(*locA.Ptr);
+        auto idB = idMap.getID(*locB.Ptr);
+        auto cacheable = cache != nullptr && idA != nullptr && idB != nullptr;
+        if (cacheable) {
+            if (auto result =
+                    cache->lookup(aa, funcID, AliasPair(*idA, *idB))) {
+                ++output.numCachedQueries;
+                return *result;
+            }
+        }
+
+        if (!aaResult)
+            aaResult.reset(new AAResults(aaManager.run(function, funManager)));
+        auto result = aaResult->alias(locA, locB);
+        if (cacheable) {
+            CacheEntry entry;
+            std::memset(&entry, 0, sizeof(entry));
+            entry.pair = AliasPairSet::packPair(AliasPair(*idA, *idB));
+            entry.func = funcID;
+            entry.result = result;
+            output.newEntries[aa].push_back(entry);
+        }
+        return result;
+    }
+};
+
+// A DidAlias pair and the locations the tested AAs are asked about
+struct Query
+{
+    const Value* valA;
+    const Value* valB;
+    MemoryLocation locA;
+    MemoryLocation locB;
+};
+
+// TBAA only tells locations apart by the type tags of the accesses to them.
+// A base is queried with the tags of the loads and stores through it and
+// through all of its pointer casts if they agree, and with no tags if they do
+// not or if there are no such accesses, since any other choice would pit one
+// of its accesses against the other pointer arbitrarily. The size is left
+// unknown, since a pointer that did alias another one may have done so in a
+// different iteration of a loop.
+MemoryLocation getLocation(const Value* base) {
+    bool found = false;
+    AAMDNodes tags;
+    auto addAccess = [&found, &tags](const AAMDNodes& accessTags) {
+        if (!found)
+            tags = accessTags;
+        else if (tags != accessTags)
+            tags = AAMDNodes();
+        found = true;
+    };
+
+    SmallVector<const Value*, 8> worklist;
+    DenseSet<const Value*> visited;
+    worklist.push_back(base);
+    visited.insert(base);
+    while (!worklist.empty()) {
+        auto ptr = worklist.pop_back_val();
+        for (auto user : ptr->users()) {
+            if (auto load = dyn_cast<LoadInst>(user)) {
+                if (load->getPointerOperand() == ptr)
+                    addAccess(MemoryLocation::get(load).AATags);
+            } else if (auto store = dyn_cast<StoreInst>(user)) {
+                if (store->getPointerOperand() == ptr)
+                    addAccess(MemoryLocation::get(store).AATags);
+            } else if (user->getType()->isPointerTy() &&
+                       user->stripPointerCasts() == base &&
+                       visited.insert(user).second) {
+                worklist.push_back(user);
+            }
+        }
+    }
+    return MemoryLocation(base, MemoryLocation::UnknownSize, tags);
+}
+
+// Pointers that only differ in casts point to the same memory, so the pairs
+// are queried on the values with their pointer casts stripped, and each pair
+// of stripped values only once
+using QueriedSet = DenseSet<std::pair<const Value*, const Value*>>;
+template <typename AliasPairRange>
+std::vector<Query> collectQueries(const AliasPairRange& aliasSet,
+                                  const IDAssigner& idMap,
+                                  QueriedSet& queried) {
+    std::vector<Query> queries;
+    // Bases are paired with many others, and finding their accesses takes a
+    // walk over their users
+    DenseMap<const Value*, MemoryLocation> locations;
+    auto getBaseLocation = [&locations](const Value* base) {
+        auto itr = locations.find(base);
+        if (itr == locations.end())
+            itr = locations.insert(std::make_pair(base, getLocation(base)))
+                      .first;
+        return itr->second;
+    };
     for (auto const& pair : aliasSet) {
         auto valA = idMap.getValue(pair.getFirst());
         auto valB = idMap.getValue(pair.getSecond());
         if (valA == nullptr || valB == nullptr)
             continue;
 
-        auto aliasResult =
-            aaResult.alias(MemoryLocation(valA), MemoryLocation(valB));
-        if (aliasResult == NoAlias) {
-            outs() << "\nFIND AA BUG:\n";
-            outs() << "  ValA = " << *valA << '\n';
-            outs() << "  ValB = " << *valB << '\n';
-            outs() << "  DynamicAA said DidAlias but the tested AA said "
-                      "NoAliasn\n";
+        auto baseA = valA->stripPointerCasts();
+        auto baseB = valB->stripPointerCasts();
+        // A value always aliases itself
+        if (baseA == baseB)
+            continue;
+        if (queried.insert(std::make_pair(std::min(baseA, baseB),
+                                          std::max(baseA, baseB)))
+                .second)
+            queries.push_back(Query{valA, valB, getBaseLocation(baseA),
+                                    getBaseLocation(baseB)});
+    }
+    return queries;
+}
+
+void checkQueries(FunctionQuerier& querier, const std::vector<Query>& queries,
+                  std::uint64_t& numBugs, raw_ostream& os) {
+    for (auto const& query : queries) {
+        if (querier.alias(query.locA, query.locB) == NoAlias) {
+            ++numBugs;
+            os << "\nFIND AA BUG:\n";
+            os << "  ValA = " << *query.valA << '\n';
+            os << "  ValB = " << *query.valB << '\n';
+            os << "  DynamicAA said DidAlias but the tested AA said "
+                  "NoAliasn\n";
+        }
+    }
+}
+
+// All tested AAs share one function analysis manager, so that the analyses
+// they depend on are only computed once per function
+void setUpAnalyses(FunctionAnalysisManager& funManager) {
+    funManager.registerPass([] { return TargetLibraryAnalysis(); });
+    funManager.registerPass([] { return AssumptionAnalysis(); });
+    funManager.registerPass([] { return DominatorTreeAnalysis(); });
+    funManager.registerPass([] { return LoopAnalysis(); });
+    funManager.registerPass([] { return ScalarEvolutionAnalysis(); });
+    funManager.registerPass([] { return BasicAA(); });
+    funManager.registerPass([] { return CFLAA(); });
+    funManager.registerPass([] { return SCEVAA(); });
+    funManager.registerPass([] { return TypeBasedAA(); });
+}
+
+// Each tested AA is asked on its own, so that its answers are not refined by
+// the other AAs
+void registerAA(AAType aa, AAManager& aaManager) {
+    switch (aa) {
+        case AAType::BasicAA:
+            aaManager.registerFunctionAnalysis<BasicAA>();
+            break;
+        case AAType::CFLAA:
+            aaManager.registerFunctionAnalysis<CFLAA>();
+            break;
+        case AAType::SCEVAA:
+            aaManager.registerFunctionAnalysis<SCEVAA>();
+            break;
+        case AAType::TBAA:
+            aaManager.registerFunctionAnalysis<TypeBasedAA>();
+            break;
+    }
+}
+
+// Check the functions of the module claimed from nextFunction, which counts
+// the functions in module order, against the AAs in aaTypes, and leave the
+// report of AA k on function i in reports[k][i]. Every worker runs its own
+// analysis managers on its own copy of the module, since neither may be
+// shared between threads.
+void checkFunctions(Module& module, const DynamicResults& results,
+                    const std::vector<AAType>& aaTypes,
+                    const AliasQueryCache* cache,
+                    std::atomic<std::size_t>& nextFunction,
+                    std::vector<std::vector<std::string>>& reports,
+                    WorkerOutput& output) {
+    FunctionAnalysisManager funManager;
+    setUpAnalyses(funManager);
+    std::vector<AAManager> aaManagers(aaTypes.size());
+    for (auto aa = 0u; aa < aaTypes.size(); ++aa)
+        registerAA(aaTypes[aa], aaManagers[aa]);
+
+    // Only the IDs of this module can be mapped back to values. Pairs that
+    // involve other modules' IDs are skipped by collectQueries().
+    IDAssigner idMap(module, ModuleID);
+    std::vector<Function*> functions;
+    for (auto& f : module)
+        functions.push_back(&f);
+
+    for (auto i = nextFunction++; i < functions.size(); i = nextFunction++) {
+        auto& f = *functions[i];
+        auto id = idMap.getID(f);
+        if (id == nullptr)
+            continue;
+
+        std::vector<Query> queries;
+        QueriedSet queried;
+        if (results.resultFile)
+            queries = collectQueries(
+                results.resultFile->getUnpackedAliasPairs(*id), idMap,
+                queried);
+        else if (auto aliasSet = results.dynAA->getAliasPairs(*id))
+            queries = collectQueries(*aliasSet, idMap, queried);
+        if (queries.empty())
+            continue;
+
+        for (auto aa = 0u; aa < aaTypes.size(); ++aa) {
+            raw_string_ostream os(reports[aa][i]);
+            FunctionQuerier querier(f, *id, idMap, aa, aaManagers[aa],
+                                    funManager, cache, output);
+            checkQueries(querier, queries, output.numBugs[aa], os);
         }
     }
 }
 
+// Pairs the dynamic analysis has newly found in a frame of func
+struct PairBatch
+{
+    DynamicPointer func;
+    std::vector<AliasPair> pairs;
+};
+
+// Pairs queued for a worker before the dynamic analysis has to wait for it
+constexpr std::size_t maxQueuedPairs = 1 << 20;
+
+// Hands the batches found by the dynamic analysis to one worker. The alias
+// analyses are usually slower than the dynamic one, so the queue is bounded
+// rather than letting it hold on to a copy of every pair.
+class PairBatchQueue
+{
+private:
+    std::mutex mutex;
+    std::condition_variable nonEmpty;
+    std::condition_variable nonFull;
+    std::deque<PairBatch> batches;
+    std::size_t numPairs = 0;
+    bool closed = false;
+
+public:
+    // Blocks while the queue is full. A batch larger than the whole queue is
+    // let in once the queue is empty.
+    void push(PairBatch batch) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            nonFull.wait(lock, [this, &batch] {
+                return numPairs == 0 ||
+                       numPairs + batch.pairs.size() <= maxQueuedPairs;
+            });
+            numPairs += batch.pairs.size();
+            batches.push_back(std::move(batch));
+        }
+        nonEmpty.notify_one();
+    }
+    // No more batches will be pushed
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        nonEmpty.notify_one();
+    }
+    // Returns false once the queue is closed and empty
+    bool pop(PairBatch& batch) {
+        std::unique_lock<std::mutex> lock(mutex);
+        nonEmpty.wait(lock, [this] { return closed || !batches.empty(); });
+        if (batches.empty())
+            return false;
+        batch = std::move(batches.front());
+        batches.pop_front();
+        numPairs -= batch.pairs.size();
+        lock.unlock();
+        // Several analysis threads may be waiting
+        nonFull.notify_all();
+        return true;
+    }
+};
+
+// Check the batches of queue as they arrive and print the reports right away.
+// All batches of a function go to the same worker, which keeps the alias
+// analysis results of the function around for the batches still to come.
+void checkBatches(Module& module, const std::vector<AAType>& aaTypes,
+                  const std::vector<std::string>& aaNames,
+                  const AliasQueryCache* cache, PairBatchQueue& queue,
+                  std::mutex& outsMutex, WorkerOutput& output) {
+    FunctionAnalysisManager funManager;
+    setUpAnalyses(funManager);
+    std::vector<AAManager> aaManagers(aaTypes.size());
+    for (auto aa = 0u; aa < aaTypes.size(); ++aa)
+        registerAA(aaTypes[aa], aaManagers[aa]);
+
+    IDAssigner idMap(module, ModuleID);
+    DenseMap<DynamicPointer, Function*> functions;
+    for (auto& f : module)
+        if (auto id = idMap.getID(f))
+            functions[*id] = &f;
+
+    // The pairs already queried and the queriers of each function seen so far
+    struct FunctionState
+    {
+        QueriedSet queried;
+        std::vector<FunctionQuerier> queriers;
+    };
+    DenseMap<DynamicPointer, std::unique_ptr<FunctionState>> states;
+
+    PairBatch batch;
+    while (queue.pop(batch)) {
+        auto itr = functions.find(batch.func);
+        if (itr == functions.end())
+            continue;
+        auto& state = states[batch.func];
+        if (!state) {
+            state.reset(new FunctionState());
+            for (auto aa = 0u; aa < aaTypes.size(); ++aa)
+                state->queriers.emplace_back(*itr->second, batch.func, idMap,
+                                             aa, aaManagers[aa], funManager,
+                                             cache, output);
+        }
+
+        auto queries = collectQueries(batch.pairs, idMap, state->queried);
+        for (auto aa = 0u; aa < aaTypes.size(); ++aa) {
+            std::string report;
+            raw_string_ostream os(report);
+            checkQueries(state->queriers[aa], queries, output.numBugs[aa], os);
+            if (os.str().empty())
+                continue;
+
+            std::lock_guard<std::mutex> lock(outsMutex);
+            if (aaTypes.size() > 1)
+                outs() << "\n=== " << aaNames[aa] << " ===\n";
+            outs() << report;
+            outs().flush();
+        }
+    }
+}
+
+// Run the dynamic analysis on this thread while numJobs workers check the
+// pairs it finds. Batches are assigned to workers by function.
+void checkWhileAnalyzing(Module& module, DynamicAliasAnalysis& dynAA,
+                         const std::vector<AAType>& aaTypes,
+                         const std::vector<std::string>& aaNames,
+                         const AliasQueryCache* cache, unsigned numJobs,
+                         std::vector<WorkerOutput>& outputs) {
+    std::vector<PairBatchQueue> queues(numJobs);
+    dynAA.setPairListener([&queues, numJobs](
+        DynamicPointer func, const std::vector<AliasPair>& pairs) {
+        queues[func % numJobs].push(PairBatch{func, pairs});
+    });
+
+    std::mutex outsMutex;
+    std::vector<std::thread> workers;
+    for (auto i = 0u; i < numJobs; ++i) {
+        auto& queue = queues[i];
+        auto& output = outputs[i];
+        // The first worker takes the module that is already parsed, which
+        // this thread does not touch until the workers are done
+        workers.emplace_back([&module, &aaTypes, &aaNames, cache, &queue,
+                              &outsMutex, &output, i] {
+            LLVMContext workerContext;
+            SMDiagnostic workerError;
+            std::unique_ptr<Module> workerModule;
+            if (i > 0) {
+                workerModule =
+                    parseIRFile(InputFilename, workerError, workerContext);
+                if (!workerModule) {
+                    // Keep draining the queue, so that the analysis does not
+                    // block on it
+                    PairBatch batch;
+                    while (queue.pop(batch))
+                        ;
+                    return;
+                }
+            }
+            checkBatches(i > 0 ? *workerModule : module, aaTypes, aaNames,
+                         cache, queue, outsMutex, output);
+        });
+    }
+
+    // The workers are joined even if the analysis fails, so that its error
+    // is reported rather than the threads being destroyed while joinable
+    auto joinWorkers = [&queues, &workers] {
+        for (auto& queue : queues)
+            queue.close();
+        for (auto& worker : workers)
+            worker.join();
+    };
+    try {
+        dynAA.runAnalysis();
+    } catch (...) {
+        joinWorkers();
+        throw;
+    }
+    joinWorkers();
+}
+}
+
 int main(int argc, char** argv) {
     cl::ParseCommandLineOptions(argc, argv);
 
+    if (ModuleID > MaxModuleID) {
+        errs() << "Module ID must not exceed " << MaxModuleID << "\n";
+        return -1;
+    }
+
     LLVMContext context;
     SMDiagnostic error;
     auto module = parseIRFile(InputFilename, error, context);
@@ -56,29 +728,110 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-    // Perform dynamic alias analysis and get all DidAlias pairs
+    // Perform dynamic alias analysis and get all DidAlias pairs, unless they
+    // have been saved to a result file already
     DynamicAliasAnalysis dynAA(LogFilename.data());
-    dynAA.runAnalysis();
+    std::unique_ptr<AliasResultFile> resultFile;
+    if (AliasResultFile::isResultFile(LogFilename.data()))
+        resultFile.reset(new AliasResultFile(
+            AliasResultFile::readFromFile(LogFilename.data())));
+    // The pairs of a result file are all there from the start, so there is
+    // nothing to stream
+    auto streaming = Stream && !resultFile;
+    if (!resultFile && !streaming)
+        dynAA.runAnalysis();
 
-    // Set up aa pipeline
-    FunctionAnalysisManager funManager;
-    funManager.registerPass([] { return TargetLibraryAnalysis(); });
-    funManager.registerPass([] { return CFLAA(); });
+    // Every AA is checked once, in the order given
+    std::vector<AAType> aaTypes;
+    std::vector<std::string> aaNames;
+    for (auto aa : AAs) {
+        if (std::find(aaTypes.begin(), aaTypes.end(), aa) != aaTypes.end())
+            continue;
+        aaTypes.push_back(aa);
+        aaNames.push_back(getAAName(aa));
+    }
 
-    AAManager aaManager;
-    switch (AA) {
-        case AAType::CFLAA:
-            aaManager.registerFunctionAnalysis<CFLAA>();
-            break;
+    std::unique_ptr<AliasQueryCache> cache;
+    if (!CacheFilename.empty()) {
+        cache.reset(
+            new AliasQueryCache(hashFile(InputFilename), ModuleID, aaNames));
+        if (!cache->readFromFile(CacheFilename)) {
+            errs() << CacheFilename << " is not an alias query cache of "
+                   << "version " << cacheVersion << "\n";
+            return -1;
+        }
     }
 
-    IDAssigner idMap(*module);
-    for (auto& f : *module) {
-        if (auto id = idMap.getID(f)) {
-            if (auto aliasSet = dynAA.getAliasPairs(*id)) {
-                auto result = aaManager.run(f, funManager);
-                checkAAResult(result, *aliasSet, idMap);
-            }
+    auto numJobs = NumJobs.getValue();
+    if (numJobs == 0)
+        numJobs = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::vector<WorkerOutput> outputs(numJobs, WorkerOutput(aaTypes.size()));
+    if (streaming) {
+        checkWhileAnalyzing(*module, dynAA, aaTypes, aaNames, cache.get(),
+                            numJobs, outputs);
+    } else {
+        // Functions are handed out one at a time, so that a few expensive
+        // ones do not hold up the rest. Each worker checks a function against
+        // all AAs, with the pairs of the function collected once. The reports
+        // are printed in module order once all functions are checked, which
+        // keeps the output independent of numJobs.
+        DynamicResults results{&dynAA, resultFile.get()};
+        std::atomic<std::size_t> nextFunction(0);
+        std::vector<std::vector<std::string>> reports(
+            aaTypes.size(), std::vector<std::string>(module->size()));
+        std::vector<std::thread> workers;
+        for (auto i = 1u; i < numJobs; ++i) {
+            auto& output = outputs[i];
+            workers.emplace_back([&results, &aaTypes, &cache, &nextFunction,
+                                  &reports, &output] {
+                LLVMContext workerContext;
+                SMDiagnostic workerError;
+                auto workerModule =
+                    parseIRFile(InputFilename, workerError, workerContext);
+                if (workerModule)
+                    checkFunctions(*workerModule, results, aaTypes,
+                                   cache.get(), nextFunction, reports, output);
+            });
+        }
+        checkFunctions(*module, results, aaTypes, cache.get(), nextFunction,
+                       reports, outputs[0]);
+        for (auto& worker : workers)
+            worker.join();
+
+        // A single AA is reported as before, several get a section each
+        for (auto aa = 0u; aa < aaTypes.size(); ++aa) {
+            if (aaTypes.size() > 1)
+                outs() << "\n=== " << aaNames[aa] << " ===\n";
+            for (auto const& report : reports[aa])
+                outs() << report;
         }
     }
-}
\ No newline at end of file
+    if (aaTypes.size() > 1) {
+        outs() << "\nSummary:\n";
+        for (auto aa = 0u; aa < aaTypes.size(); ++aa) {
+            std::uint64_t numBugs = 0;
+            for (auto const& output : outputs)
+                numBugs += output.numBugs[aa];
+            outs() << "  " << aaNames[aa] << ": " << numBugs
+                   << " DidAlias pairs reported as NoAlias\n";
+        }
+    }
+
+    if (cache) {
+        std::uint64_t numQueries = 0, numCachedQueries = 0;
+        for (auto const& output : outputs) {
+            numQueries += output.numQueries;
+            numCachedQueries += output.numCachedQueries;
+            for (auto aa = 0u; aa < aaTypes.size(); ++aa)
+                for (auto const& entry : output.newEntries[aa])
+                    cache->insert(aa, entry);
+        }
+        errs() << "Answered " << numCachedQueries << " of " << numQueries
+               << " alias queries from " << CacheFilename << "\n";
+        if (!cache->writeToFile(CacheFilename)) {
+            errs() << "Cannot write " << CacheFilename << "\n";
+            return -1;
+        }
+    }
+}
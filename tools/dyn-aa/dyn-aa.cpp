@@ -1,27 +1,220 @@
+#include "Dynamic/Analysis/AliasResultFile.h"
 #include "Dynamic/Analysis/DynamicAliasAnalysis.h"
+#include "Dynamic/Log/LogIndex.h"
 
+#include <llvm/Support/CommandLine.h>
+
+#include <algorithm>
 #include <iostream>
+#include <sstream>
+
+using namespace llvm;
+
+cl::opt<std::string> LogFilename(cl::Positional,
+                                 cl::desc("<input log filename>"),
+                                 cl::Required);
+cl::opt<std::string> OutputFilename(
+    "o",
+    cl::desc("Write the alias pairs to a binary result file instead of "
+             "printing them"),
+    cl::value_desc("filename"));
+cl::opt<unsigned> NumDecoders(
+    "decode-threads",
+    cl::desc("Number of threads that decode the log while it is analyzed (0 "
+             "decodes on the analysis thread)"),
+    cl::value_desc("n"), cl::init(0));
+cl::opt<unsigned> NumWorkers(
+    "threads",
+    cl::desc("Number of threads that search completed frames for alias pairs"),
+    cl::value_desc("n"), cl::init(1));
+cl::opt<std::string> IndexFilename(
+    "index", cl::desc("Index of the log file, as written by log-index"),
+    cl::value_desc("filename"));
+cl::list<unsigned> Functions(
+    "functions",
+    cl::desc("Only analyze the frames of these functions (requires -index)"),
+    cl::value_desc("id,id,..."), cl::CommaSeparated);
+cl::opt<std::string> Shard(
+    "shard",
+    cl::desc("Only analyze the records between these byte offsets of the log "
+             "(requires -index and -partial-frames)"),
+    cl::value_desc("begin:end"));
+cl::opt<std::string> PartialFramesFilename(
+    "partial-frames",
+    cl::desc("Where to save the frames open at either end of the shard"),
+    cl::value_desc("filename"));
+cl::opt<unsigned> ContextDepth(
+    "context-depth",
+    cl::desc("Summarize functions separately per call string of up to this "
+             "many call sites (0 merges all invocations)"),
+    cl::value_desc("k"), cl::init(0));
+cl::opt<unsigned> MaxContexts(
+    "max-contexts",
+    cl::desc("Number of call strings kept before falling back to shorter "
+             "ones"),
+    cl::value_desc("n"), cl::init(1 << 20));
+cl::opt<unsigned> MaxContextSummaries(
+    "max-context-summaries",
+    cl::desc("Number of (function, call string) summaries kept before "
+             "falling back to shorter call strings"),
+    cl::value_desc("n"), cl::init(1 << 20));
+cl::opt<std::string> CheckpointFilename(
+    "checkpoint",
+    cl::desc("Periodically save the state of the analysis to this file"),
+    cl::value_desc("filename"));
+cl::opt<unsigned> CheckpointInterval(
+    "checkpoint-interval",
+    cl::desc("Megabytes of log analyzed between two checkpoints (0 only "
+             "saves the state at the end of the log)"),
+    cl::value_desc("MB"), cl::init(1024));
+cl::opt<std::string> ResumeFilename(
+    "resume",
+    cl::desc("Continue the analysis from the state saved in this checkpoint "
+             "file"),
+    cl::value_desc("filename"));
+cl::opt<unsigned> MemoryBudget(
+    "memory-budget",
+    cl::desc("Megabytes of memory the analysis tries to stay within by "
+             "spilling to disk (0 for no bound)"),
+    cl::value_desc("MB"), cl::init(0));
+cl::opt<std::string> SpillDirectory(
+    "spill-dir",
+    cl::desc("Directory of the files spilled to disk (defaults to $TMPDIR or "
+             "/tmp)"),
+    cl::value_desc("directory"));
+cl::opt<bool> ObjectGranularity(
+    "objects",
+    cl::desc("Report pointers into the same allocated object as aliases, "
+             "using the allocation sizes in the log"));
 
 int main(int argc, char** argv) {
     // Unsync iostream with C I/O libraries to accelerate standard iostreams
     std::ios::sync_with_stdio(false);
 
-    if (argc != 2) {
-        std::cout << "Usage: " << argv[0] << " <input log filename>\n\n";
+    cl::ParseCommandLineOptions(argc, argv);
+
+    if (MemoryBudget > 0 && ContextDepth > 0) {
+        std::cerr << "-memory-budget cannot be combined with -context-depth\n";
+        std::exit(-1);
+    }
+    if (MemoryBudget > 0 && !Functions.empty() && Shard.empty()) {
+        std::cerr << "-memory-budget cannot be combined with -functions\n";
         std::exit(-1);
     }
+    // The objects allocated before a shard or outside of the selected
+    // functions are not known
+    if (ObjectGranularity && (!Shard.empty() || !Functions.empty())) {
+        std::cerr << "-objects cannot be combined with -shard or -functions\n";
+        std::exit(-1);
+    }
+
+    dynamic::DynamicAliasAnalysis dynAA(LogFilename.data());
+    if (ContextDepth > 0)
+        dynAA.setContextSensitivity(ContextDepth, MaxContexts,
+                                    MaxContextSummaries);
+    dynAA.setMemoryBudget(std::size_t(MemoryBudget) << 20, SpillDirectory);
+    dynAA.setObjectGranularity(ObjectGranularity);
+    if (!Shard.empty()) {
+        std::uint64_t beginOffset, endOffset;
+        char sep;
+        std::istringstream ss(Shard);
+        if (!(ss >> beginOffset >> sep >> endOffset) || sep != ':' ||
+            beginOffset > endOffset) {
+            std::cerr << "-shard expects <begin>:<end>\n";
+            std::exit(-1);
+        }
+        if (IndexFilename.empty() || PartialFramesFilename.empty()) {
+            std::cerr << "-shard requires -index and -partial-frames\n";
+            std::exit(-1);
+        }
+        auto index = dynamic::LogIndex::readFromFile(IndexFilename.data());
+        dynAA.runAnalysisOnShard(index, beginOffset, endOffset,
+                                 PartialFramesFilename.data(), NumWorkers);
+    } else if (!Functions.empty()) {
+        if (IndexFilename.empty()) {
+            std::cerr << "-functions requires a log index\n";
+            std::exit(-1);
+        }
+        auto index = dynamic::LogIndex::readFromFile(IndexFilename.data());
+        dynAA.runAnalysisOnFunctions(
+            index, std::vector<dynamic::DynamicPointer>(Functions.begin(),
+                                                        Functions.end()));
+    } else if (!CheckpointFilename.empty() || !ResumeFilename.empty()) {
+        dynAA.runCheckpointedAnalysis(
+            CheckpointFilename.empty() ? nullptr : CheckpointFilename.data(),
+            std::uint64_t(CheckpointInterval) << 20,
+            ResumeFilename.empty() ? nullptr : ResumeFilename.data(),
+            NumWorkers);
+    } else
+        dynAA.runAnalysis(NumDecoders, NumWorkers);
+
+    auto const& contexts = dynAA.getContextTable();
+    if (contexts.getNumDegraded() > 0 || dynAA.getNumDegradedSummaries() > 0)
+        std::cerr << "Context limits reached: " << contexts.getNumDegraded()
+                  << " calls got and " << dynAA.getNumDegradedSummaries()
+                  << " frames were summarized under shorter call strings\n";
+    if (dynAA.getNumSpilledRuns() > 0 || dynAA.getNumSpilledFrames() > 0)
+        std::cerr << "Memory budget reached: " << dynAA.getNumSpilledRuns()
+                  << " runs of alias pairs and "
+                  << dynAA.getNumSpilledFrames()
+                  << " frames were spilled to disk\n";
 
-    dynamic::DynamicAliasAnalysis dynAA(argv[1]);
-    dynAA.runAnalysis();
+    if (!OutputFilename.empty()) {
+        dynamic::AliasResultFile::writeAnalysis(OutputFilename.data(), dynAA);
+        return 0;
+    }
 
+    // Print in a fixed order, which does not depend on how the frames were
+    // distributed over the threads
+    std::vector<dynamic::DynamicPointer> funcs;
     for (auto const& mapping : dynAA) {
-        if (mapping.second.empty())
-            continue;
+        if (!mapping.second.empty())
+            funcs.push_back(mapping.first);
+    }
+    std::sort(funcs.begin(), funcs.end());
+
+    std::vector<dynamic::AliasPair> pairs;
+    if (ContextDepth > 0) {
+        using ContextEntry =
+            std::pair<dynamic::DynamicPointer,
+                      std::vector<dynamic::DynamicPointer>>;
+        std::vector<std::pair<ContextEntry, dynamic::ContextID>> entries;
+        for (auto const& mapping : dynAA.getContextAliasPairs()) {
+            if (!mapping.second.empty())
+                entries.emplace_back(
+                    ContextEntry(mapping.first.first,
+                                 contexts.getCallSites(mapping.first.second)),
+                    mapping.first.second);
+        }
+        std::sort(entries.begin(), entries.end());
+
+        for (auto const& entry : entries) {
+            auto const& aliasPairs = dynAA.getContextAliasPairs().find(
+                std::make_pair(entry.first.first, entry.second))->second;
+            pairs.assign(aliasPairs.begin(), aliasPairs.end());
+            std::sort(pairs.begin(), pairs.end());
+
+            std::cout << "Function# " << entry.first.first << ", Context# [";
+            for (auto i = 0u; i < entry.first.second.size(); ++i)
+                std::cout << (i == 0 ? "" : ", ") << entry.first.second[i];
+            std::cout << "]:\n";
+            for (auto const& pair : pairs) {
+                std::cout << "  Ptr# " << pair.getFirst() << ", Ptr# "
+                          << pair.getSecond() << '\n';
+            }
+        }
+        return 0;
+    }
+
+    for (auto func : funcs) {
+        auto aliasPairs = dynAA.getAliasPairs(func);
+        pairs.assign(aliasPairs->begin(), aliasPairs->end());
+        std::sort(pairs.begin(), pairs.end());
 
-        std::cout << "Function# " << mapping.first << ":\n";
-        for (auto const& pair : mapping.second) {
+        std::cout << "Function# " << func << ":\n";
+        for (auto const& pair : pairs) {
             std::cout << "  Ptr# " << pair.getFirst() << ", Ptr# "
                       << pair.getSecond() << '\n';
         }
     }
-}
\ No newline at end of file
+}
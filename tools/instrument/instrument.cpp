@@ -1,3 +1,4 @@
+#include "Dynamic/Instrument/IDAssigner.h"
 #include "Dynamic/Instrument/MemoryInstrument.h"
 
 #include <llvm/Bitcode/ReaderWriter.h>
@@ -15,6 +16,16 @@ cl::opt<std::string> InputFilename(cl::Positional, cl::desc("<input file>"),
                                    cl::init("-"));
 cl::opt<std::string> OutputFilename("o", cl::desc("Specify output filename"),
                                     cl::value_desc("filename"), cl::Required);
+cl::opt<unsigned> ModuleID(
+    "module-id",
+    cl::desc("Give the module its own ID range so that it can be linked with "
+             "other separately instrumented modules (1 to 1023, 0 means "
+             "whole program)"),
+    cl::value_desc("id"), cl::init(0));
+cl::opt<bool> LogAllAllocas(
+    "log-all-allocas",
+    cl::desc("Also log allocas whose address never escapes the function"),
+    cl::init(false));
 
 int main(int argc, char** argv) {
     cl::ParseCommandLineOptions(argc, argv);
@@ -27,7 +38,12 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-    dynamic::MemoryInstrument().runOnModule(*module);
+    if (ModuleID > dynamic::MaxModuleID) {
+        errs() << "Module ID must not exceed " << dynamic::MaxModuleID << "\n";
+        return -1;
+    }
+
+    dynamic::MemoryInstrument(ModuleID, !LogAllAllocas).runOnModule(*module);
 
     std::error_code ec;
     tool_output_file outFile(OutputFilename, ec, sys::fs::OpenFlags::F_None);
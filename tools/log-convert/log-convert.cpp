@@ -0,0 +1,14 @@
+#include "Dynamic/Log/ColumnarLog.h"
+
+#include <iostream>
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cout << "Usage: " << argv[0]
+                  << " <input log filename> <output columnar log filename>\n\n";
+        std::exit(-1);
+    }
+
+    dynamic::MappedLogReader reader(argv[1]);
+    dynamic::ColumnarLogWriter::convert(reader, argv[2]);
+}
\ No newline at end of file
@@ -1,15 +1,261 @@
 #include "Dynamic/Log/LogPrinter.h"
+#include "Dynamic/Log/ParallelLogReader.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
-int main(int argc, char** argv) {
-    // Unsync iostream with C I/O libraries to accelerate standard iostreams
-    std::ios::sync_with_stdio(false);
+using namespace dynamic;
+
+namespace {
+
+struct Options {
+    const char* fileName = nullptr;
+    LogFilter filter;
+    bool stats = false;
+    unsigned top = 20;
+    unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+};
+
+struct LogStats {
+    std::uint64_t typeCounts[TThreadRec + 1] = {};
+    std::unordered_map<unsigned, std::uint64_t> funcCounts;
+    std::unordered_map<unsigned, std::uint64_t> ptrCounts;
+
+    void merge(const LogStats& other) {
+        for (auto i = 0u; i <= TThreadRec; ++i)
+            typeCounts[i] += other.typeCounts[i];
+        for (auto const& mapping : other.funcCounts)
+            funcCounts[mapping.first] += mapping.second;
+        for (auto const& mapping : other.ptrCounts)
+            ptrCounts[mapping.first] += mapping.second;
+    }
+};
+
+[[noreturn]] void printUsage(const char* progName) {
+    std::cout
+        << "Usage: " << progName << " [options] <input log filename>\n\n"
+        << "Options:\n"
+        << "  --type=<type>,...    Only dump records of these types (alloc, "
+           "pointer, enter, exit, call, thread)\n"
+        << "  --id=<id>,...        Only dump records with these IDs\n"
+        << "  --addr=<lo>:<hi>     Only dump records with an address in "
+           "[lo, hi]\n"
+        << "  --index=<lo>:<hi>    Only dump records numbered [lo, hi) in log "
+           "order\n"
+        << "  --stats              Print record statistics instead of the "
+           "records\n"
+        << "  --top=<n>            Number of pointer IDs listed by --stats "
+           "(default 20)\n"
+        << "  --threads=<n>        Number of threads used by --stats\n\n";
+    std::exit(-1);
+}
+
+bool hasPrefix(const char* arg, const char* prefix, const char*& value) {
+    auto len = std::strlen(prefix);
+    if (std::strncmp(arg, prefix, len) != 0)
+        return false;
+    value = arg + len;
+    return true;
+}
+
+std::uint64_t parseNumber(const char* str, const char*& end,
+                          const char* progName) {
+    char* numEnd;
+    errno = 0;
+    auto num = std::strtoull(str, &numEnd, 0);
+    if (numEnd == str || errno != 0)
+        printUsage(progName);
+    end = numEnd;
+    return num;
+}
+
+void parseRange(const char* str, std::uint64_t& lo, std::uint64_t& hi,
+                const char* progName) {
+    const char* end;
+    lo = parseNumber(str, end, progName);
+    if (*end != ':')
+        printUsage(progName);
+    hi = parseNumber(end + 1, end, progName);
+    if (*end != '\0')
+        printUsage(progName);
+}
+
+unsigned parseType(const char* str, std::size_t len, const char* progName) {
+    static const char* typeNames[] = {"alloc", "pointer", "enter", "exit",
+                                      "call",  "thread"};
+    for (auto i = 0u; i <= TThreadRec; ++i)
+        if (std::strlen(typeNames[i]) == len &&
+            std::strncmp(str, typeNames[i], len) == 0)
+            return i;
+    printUsage(progName);
+}
 
-    if (argc != 2) {
-        std::cout << "Usage: " << argv[0] << " <input log filename>\n\n";
+Options parseOptions(int argc, char** argv) {
+    Options opts;
+    for (auto i = 1; i < argc; ++i) {
+        auto arg = argv[i];
+        const char* value;
+        if (hasPrefix(arg, "--type=", value)) {
+            unsigned mask = 0;
+            while (true) {
+                auto sep = std::strchr(value, ',');
+                auto len = sep ? sep - value : std::strlen(value);
+                mask |= 1u << parseType(value, len, argv[0]);
+                if (!sep)
+                    break;
+                value = sep + 1;
+            }
+            opts.filter.setTypeMask(mask);
+        } else if (hasPrefix(arg, "--id=", value)) {
+            while (true) {
+                const char* end;
+                opts.filter.addID(parseNumber(value, end, argv[0]));
+                if (*end == '\0')
+                    break;
+                if (*end != ',')
+                    printUsage(argv[0]);
+                value = end + 1;
+            }
+        } else if (hasPrefix(arg, "--addr=", value)) {
+            std::uint64_t lo, hi;
+            parseRange(value, lo, hi, argv[0]);
+            opts.filter.setAddressRange(lo, hi);
+        } else if (hasPrefix(arg, "--index=", value)) {
+            std::uint64_t lo, hi;
+            parseRange(value, lo, hi, argv[0]);
+            opts.filter.setIndexWindow(lo, hi);
+        } else if (std::strcmp(arg, "--stats") == 0) {
+            opts.stats = true;
+        } else if (hasPrefix(arg, "--top=", value)) {
+            const char* end;
+            opts.top = parseNumber(value, end, argv[0]);
+        } else if (hasPrefix(arg, "--threads=", value)) {
+            const char* end;
+            opts.numThreads = std::max<unsigned>(
+                parseNumber(value, end, argv[0]), 1u);
+        } else if (arg[0] == '-' || opts.fileName != nullptr) {
+            printUsage(argv[0]);
+        } else {
+            opts.fileName = arg;
+        }
+    }
+
+    if (opts.fileName == nullptr)
+        printUsage(argv[0]);
+    // Chunks are processed out of order, so record indices are unknown
+    if (opts.stats && opts.filter.hasIndexWindow()) {
+        std::cerr << "--index cannot be used together with --stats\n";
         std::exit(-1);
     }
+    return opts;
+}
+
+void collectStats(const char* begin, const char* end, const LogFilter& filter,
+                  LogStats& stats) {
+    LogRecord rec;
+    while (begin != end) {
+        begin = decodeLogRecord(begin, end, rec);
+        switch (rec.type) {
+            case TAllocRec:
+                if (filter.accepts(0, rec.type, rec.allocRecord.id,
+                                   rec.allocRecord.address)) {
+                    ++stats.typeCounts[rec.type];
+                    ++stats.ptrCounts[rec.allocRecord.id];
+                }
+                break;
+            case TPointerRec:
+                if (filter.accepts(0, rec.type, rec.ptrRecord.id,
+                                   rec.ptrRecord.address)) {
+                    ++stats.typeCounts[rec.type];
+                    ++stats.ptrCounts[rec.ptrRecord.id];
+                }
+                break;
+            case TEnterRec:
+                if (filter.accepts(0, rec.type, rec.enterRecord.id)) {
+                    ++stats.typeCounts[rec.type];
+                    ++stats.funcCounts[rec.enterRecord.id];
+                }
+                break;
+            case TExitRec:
+                if (filter.accepts(0, rec.type, rec.exitRecord.id))
+                    ++stats.typeCounts[rec.type];
+                break;
+            case TCallRec:
+                if (filter.accepts(0, rec.type, rec.callRecord.id))
+                    ++stats.typeCounts[rec.type];
+                break;
+            case TThreadRec:
+                if (filter.accepts(0, rec.type, rec.threadRecord.id))
+                    ++stats.typeCounts[rec.type];
+                break;
+            case TSizedAllocRec:
+                // Decoded as a TAllocRec
+                break;
+        }
+    }
+}
+
+// Sort by decreasing count, breaking ties by ID to keep the output stable
+std::vector<std::pair<unsigned, std::uint64_t>> sortByCount(
+    const std::unordered_map<unsigned, std::uint64_t>& counts) {
+    std::vector<std::pair<unsigned, std::uint64_t>> ret(counts.begin(),
+                                                        counts.end());
+    std::sort(ret.begin(), ret.end(), [](auto const& lhs, auto const& rhs) {
+        return lhs.second > rhs.second ||
+               (lhs.second == rhs.second && lhs.first < rhs.first);
+    });
+    return ret;
+}
+
+void printStats(const Options& opts) {
+    MappedLogReader reader(opts.fileName);
+    LogStats stats;
+    std::mutex statsMutex;
+    ParallelLogReader::forEachChunk(
+        reader, opts.numThreads, [&](const char* begin, const char* end) {
+            LogStats chunkStats;
+            collectStats(begin, end, opts.filter, chunkStats);
+            std::lock_guard<std::mutex> lock(statsMutex);
+            stats.merge(chunkStats);
+        });
+
+    static const char* typeNames[] = {"ALLOC", "POINTER", "ENTER", "EXIT",
+                                      "CALL",  "THREAD"};
+    std::uint64_t numRecords = 0;
+    for (auto count : stats.typeCounts)
+        numRecords += count;
+    std::cout << "Records: " << numRecords << '\n';
+    for (auto i = 0u; i <= TThreadRec; ++i)
+        std::cout << "  [" << typeNames[i] << "] " << stats.typeCounts[i]
+                  << '\n';
+
+    std::cout << "Function invocations:\n";
+    for (auto const& entry : sortByCount(stats.funcCounts))
+        std::cout << "  Function# " << entry.first << ": " << entry.second
+                  << '\n';
+
+    auto ptrCounts = sortByCount(stats.ptrCounts);
+    if (ptrCounts.size() > opts.top)
+        ptrCounts.resize(opts.top);
+    std::cout << "Top pointer IDs:\n";
+    for (auto const& entry : ptrCounts)
+        std::cout << "  Ptr# " << entry.first << ": " << entry.second << '\n';
+}
+}
+
+int main(int argc, char** argv) {
+    // Unsync iostream with C I/O libraries to accelerate standard iostreams
+    std::ios::sync_with_stdio(false);
 
-    dynamic::LogPrinter(argv[1], std::cout).process();
+    auto opts = parseOptions(argc, argv);
+    if (opts.stats)
+        printStats(opts);
+    else
+        LogPrinter(opts.fileName, std::cout, std::move(opts.filter)).process();
 }
\ No newline at end of file
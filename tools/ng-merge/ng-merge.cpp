@@ -0,0 +1,43 @@
+#include "Dynamic/Analysis/AliasResultFile.h"
+
+#include <llvm/Support/CommandLine.h>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+using namespace llvm;
+
+cl::list<std::string> InputFilenames(cl::Positional,
+                                     cl::desc("<input alias result files>"),
+                                     cl::OneOrMore);
+cl::opt<std::string> OutputFilename("o", cl::desc("Output alias result file"),
+                                    cl::value_desc("filename"), cl::Required);
+cl::opt<unsigned> NumThreads(
+    "j", cl::desc("Number of threads that merge the results (0 uses one per "
+                  "core)"),
+    cl::value_desc("n"), cl::init(0));
+
+int main(int argc, char** argv) {
+    cl::ParseCommandLineOptions(argc, argv,
+                                "Union the alias pairs of many result files\n");
+
+    std::vector<dynamic::AliasResultFile> inputs;
+    inputs.reserve(InputFilenames.size());
+    for (auto const& fileName : InputFilenames)
+        inputs.push_back(dynamic::AliasResultFile::readFromFile(fileName.data()));
+
+    std::vector<const dynamic::AliasResultFile*> inputPtrs;
+    for (auto const& input : inputs)
+        inputPtrs.push_back(&input);
+
+    auto numThreads = NumThreads.getValue();
+    if (numThreads == 0)
+        numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    auto merged = dynamic::AliasResultFile::merge(inputPtrs, numThreads);
+    merged.writeToFile(OutputFilename.data());
+
+    std::cerr << "Merged " << inputs.size() << " result files: "
+              << merged.getFunctions().size() << " functions, "
+              << merged.getNumPairs() << " alias pairs\n";
+}
@@ -0,0 +1,344 @@
+#include "Dynamic/Analysis/AliasResultFile.h"
+#include "Dynamic/Analysis/DynamicAliasAnalysis.h"
+#include "Dynamic/Log/LogIndex.h"
+
+#include <llvm/Support/CommandLine.h>
+
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace llvm;
+
+cl::opt<std::string> LogFilename(cl::Positional,
+                                 cl::desc("<input log filename>"),
+                                 cl::Required);
+cl::opt<std::string> OutputFilename("o", cl::desc("Output alias result file"),
+                                    cl::value_desc("filename"), cl::Required);
+cl::opt<unsigned> NumShards(
+    "shards", cl::desc("Number of shards to split the log into (0 makes two "
+                       "per parallel worker)"),
+    cl::value_desc("n"), cl::init(0));
+cl::opt<unsigned> NumParallel(
+    "j", cl::desc("Number of shard workers run at the same time (0 uses one "
+                  "per core)"),
+    cl::value_desc("n"), cl::init(0));
+cl::opt<unsigned> NumThreads(
+    "threads", cl::desc("Number of threads of each shard worker"),
+    cl::value_desc("n"), cl::init(1));
+cl::opt<unsigned> MemoryLimit(
+    "memory-limit",
+    cl::desc("Limit on the memory each shard worker allocates, in megabytes "
+             "(0 for none). The mapped log does not count."),
+    cl::value_desc("MB"), cl::init(0));
+cl::opt<unsigned> MemoryBudget(
+    "memory-budget",
+    cl::desc("Megabytes of memory each shard worker tries to stay within by "
+             "spilling to disk (defaults to half of -memory-limit)"),
+    cl::value_desc("MB"), cl::init(0));
+cl::opt<std::string> WorkDirectory(
+    "work-dir",
+    cl::desc("Directory for the index and the shard results (defaults to "
+             "<output>.shards). Shards finished by an earlier run are reused."),
+    cl::value_desc("directory"));
+cl::opt<std::string> DynAAPath(
+    "dyn-aa",
+    cl::desc("Path of the dyn-aa binary (defaults to the one next to this "
+             "tool)"),
+    cl::value_desc("path"));
+
+namespace {
+
+struct ShardInfo
+{
+    std::uint64_t beginOffset;
+    std::uint64_t endOffset;
+    std::string resultFile;
+    std::string partialFramesFile;
+    std::string doneFile;
+};
+
+bool fileExists(const std::string& fileName) {
+    struct stat fileStat;
+    return ::stat(fileName.data(), &fileStat) == 0;
+}
+
+// Cut the log near every multiple of logSize / numShards, at the record
+// boundary with the fewest open frames in a short window after it. The fewer
+// frames are open at a cut, the fewer partial frames the reduce step has to
+// put together.
+std::vector<std::uint64_t>
+findShardBoundaries(const dynamic::MappedLogReader& reader,
+                    unsigned numShards) {
+    auto logSize = reader.size();
+    auto window = std::max<std::uint64_t>(logSize / numShards / 4, 1);
+
+    std::vector<std::uint64_t> boundaries{0};
+    unsigned nextShard = 1;
+    std::uint64_t target = logSize / numShards;
+    std::uint64_t bestOffset = 0;
+    std::size_t bestDepth = ~std::size_t(0);
+    std::size_t depth = 0;
+    for (auto itr = reader.begin(), ite = reader.end();
+         itr != ite && nextShard < numShards; ++itr) {
+        std::uint64_t offset = itr.getPosition() - reader.data();
+        if (offset >= target) {
+            if (depth < bestDepth) {
+                bestOffset = offset;
+                bestDepth = depth;
+            }
+            if (depth == 0 || offset >= target + window) {
+                if (bestOffset > boundaries.back())
+                    boundaries.push_back(bestOffset);
+                ++nextShard;
+                target = logSize / numShards * nextShard;
+                bestDepth = ~std::size_t(0);
+            }
+        }
+
+        if (itr->type == TEnterRec)
+            ++depth;
+        else if (itr->type == TExitRec && depth > 0)
+            --depth;
+    }
+    if (logSize > boundaries.back())
+        boundaries.push_back(logSize);
+    return boundaries;
+}
+
+pid_t startShard(const ShardInfo& shard, const std::string& indexFile,
+                 unsigned memoryBudget) {
+    auto shardArg = std::to_string(shard.beginOffset) + ":" +
+                    std::to_string(shard.endOffset);
+    std::vector<std::string> args{DynAAPath,
+                                  LogFilename,
+                                  "-index=" + indexFile,
+                                  "-shard=" + shardArg,
+                                  "-partial-frames=" + shard.partialFramesFile,
+                                  "-threads=" + std::to_string(NumThreads),
+                                  "-o=" + shard.resultFile};
+    if (memoryBudget > 0)
+        args.push_back("-memory-budget=" + std::to_string(memoryBudget));
+
+    auto pid = ::fork();
+    if (pid != 0)
+        return pid;
+
+    // In the worker: a runaway shard fails alone instead of exhausting the
+    // memory of the machine. The data limit leaves out read-only file
+    // mappings, so the whole log can be mapped by every worker no matter how
+    // large it is.
+    if (MemoryLimit > 0) {
+        struct rlimit limit;
+        limit.rlim_cur = limit.rlim_max = rlim_t(MemoryLimit) << 20;
+        ::setrlimit(RLIMIT_DATA, &limit);
+    }
+
+    std::vector<char*> argv;
+    for (auto& arg : args)
+        argv.push_back(&arg[0]);
+    argv.push_back(nullptr);
+    ::execv(argv[0], argv.data());
+    std::cerr << "Cannot run " << DynAAPath << ": " << std::strerror(errno)
+              << "\n";
+    ::_exit(127);
+}
+
+// Size, modification time and a hash of the contents of the log, so that the
+// shards of one log are never mistaken for those of another one cut at the
+// same offsets
+std::string identifyLog(const dynamic::MappedLogReader& reader) {
+    struct stat fileStat;
+    if (::stat(LogFilename.data(), &fileStat) != 0)
+        return std::string();
+
+    // Hashed a word at a time, which keeps up with reading the log
+    auto data = reader.data();
+    auto size = reader.size();
+    std::uint64_t hash = 14695981039346656037ull;
+    std::size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+
+    return std::to_string(size) + " " + std::to_string(fileStat.st_mtime) +
+           "." + std::to_string(fileStat.st_mtim.tv_nsec) + " " +
+           std::to_string(hash);
+}
+
+// Remove the results of the shards of another log
+bool removeShardFiles(const std::string& workDir) {
+    auto dir = ::opendir(workDir.data());
+    if (dir == nullptr)
+        return false;
+    std::vector<std::string> stale;
+    while (auto entry = ::readdir(dir)) {
+        if (std::strncmp(entry->d_name, "shard-", 6) == 0)
+            stale.push_back(workDir + "/" + entry->d_name);
+    }
+    ::closedir(dir);
+    for (auto const& fileName : stale)
+        if (std::remove(fileName.data()) != 0)
+            return false;
+    return true;
+}
+
+std::string describeStatus(int status) {
+    if (WIFEXITED(status))
+        return "exited with status " + std::to_string(WEXITSTATUS(status));
+    if (WIFSIGNALED(status))
+        return "was killed by signal " + std::to_string(WTERMSIG(status));
+    return "failed";
+}
+}
+
+int main(int argc, char** argv) {
+    cl::ParseCommandLineOptions(
+        argc, argv, "Run the dynamic analysis on shards of a log in separate "
+                    "processes and merge their results\n");
+
+    auto numParallel = NumParallel.getValue();
+    if (numParallel == 0)
+        numParallel = std::max(std::thread::hardware_concurrency(), 1u);
+    auto numShards = NumShards.getValue();
+    if (numShards == 0)
+        numShards = numParallel * 2;
+    // Spilling keeps a worker well below its limit, so that it is only hit by
+    // what the budget does not account for
+    auto memoryBudget = MemoryBudget.getNumOccurrences() > 0
+                            ? MemoryBudget.getValue()
+                            : MemoryLimit / 2;
+    if (DynAAPath.empty()) {
+        std::string self = argv[0];
+        auto slash = self.rfind('/');
+        DynAAPath = (slash == std::string::npos ? std::string(".")
+                                                : self.substr(0, slash)) +
+                    "/dyn-aa";
+    }
+
+    auto workDir = WorkDirectory.empty() ? OutputFilename + ".shards"
+                                         : WorkDirectory.getValue();
+    if (::mkdir(workDir.data(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Cannot create " << workDir << ": " << std::strerror(errno)
+                  << "\n";
+        return -1;
+    }
+
+    // Shards finished by an earlier run are only reused if that run was on
+    // the same log
+    dynamic::MappedLogReader reader(LogFilename.data());
+    auto identityFile = workDir + "/log.id";
+    auto identity = identifyLog(reader);
+    std::string oldIdentity;
+    std::getline(std::ifstream(identityFile.data()), oldIdentity);
+    if (identity.empty() || identity != oldIdentity) {
+        if (!removeShardFiles(workDir)) {
+            std::cerr << "Cannot remove the shards of another log from "
+                      << workDir << "\n";
+            return -1;
+        }
+        std::ofstream(identityFile.data()) << identity << "\n";
+    }
+
+    // The index tells each shard which globals and frames precede it
+    auto indexFile = workDir + "/log.idx";
+    auto index = dynamic::LogIndex::build(reader);
+    if (index.getNumThreads() > 1) {
+        std::cerr << "Logs of multi-threaded programs cannot be sharded. Use "
+                     "dyn-aa -threads instead.\n";
+        return -1;
+    }
+    index.writeToFile(indexFile.data());
+
+    auto boundaries = findShardBoundaries(reader, numShards);
+    std::vector<ShardInfo> shards;
+    for (auto i = 0u; i + 1 < boundaries.size(); ++i) {
+        auto prefix = workDir + "/shard-" + std::to_string(boundaries[i]) +
+                      "-" + std::to_string(boundaries[i + 1]);
+        shards.push_back(ShardInfo{boundaries[i], boundaries[i + 1],
+                                   prefix + ".res", prefix + ".part",
+                                   prefix + ".done"});
+    }
+
+    std::map<pid_t, const ShardInfo*> running;
+    std::vector<std::string> failures;
+    auto waitForShard = [&] {
+        int status;
+        auto pid = ::wait(&status);
+        if (pid == -1)
+            return;
+        auto shard = running[pid];
+        running.erase(pid);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+            std::ofstream(shard->doneFile.data());
+        else
+            failures.push_back("shard [" + std::to_string(shard->beginOffset) +
+                               ", " + std::to_string(shard->endOffset) + ") " +
+                               describeStatus(status));
+    };
+    for (auto const& shard : shards) {
+        if (fileExists(shard.doneFile))
+            continue;
+        while (running.size() >= numParallel)
+            waitForShard();
+        auto pid = startShard(shard, indexFile, memoryBudget);
+        if (pid == -1) {
+            failures.push_back("shard [" + std::to_string(shard.beginOffset) +
+                               ", " + std::to_string(shard.endOffset) +
+                               ") could not be started");
+            continue;
+        }
+        running[pid] = &shard;
+    }
+    while (!running.empty())
+        waitForShard();
+
+    if (!failures.empty()) {
+        for (auto const& failure : failures)
+            std::cerr << "Analysis of " << failure << "\n";
+        std::cerr << "The other shards are kept in " << workDir
+                  << ". Run again to retry the failed ones.\n";
+        return 1;
+    }
+
+    // Reduce: frames cut by shard boundaries are put together and searched,
+    // and the results of all shards are merged
+    std::vector<std::string> partialFramesFiles;
+    std::vector<dynamic::AliasResultFile> results;
+    for (auto const& shard : shards) {
+        partialFramesFiles.push_back(shard.partialFramesFile);
+        results.push_back(
+            dynamic::AliasResultFile::readFromFile(shard.resultFile.data()));
+    }
+    dynamic::DynamicAliasAnalysis reducer(LogFilename.data());
+    reducer.reducePartialFrames(index, partialFramesFiles);
+    results.push_back(dynamic::AliasResultFile::fromAnalysis(reducer));
+
+    std::vector<const dynamic::AliasResultFile*> resultPtrs;
+    for (auto const& result : results)
+        resultPtrs.push_back(&result);
+    auto merged = dynamic::AliasResultFile::merge(resultPtrs, numParallel);
+    merged.writeToFile(OutputFilename.data());
+
+    std::cerr << "Analyzed " << shards.size() << " shards: "
+              << merged.getFunctions().size() << " functions, "
+              << merged.getNumPairs() << " alias pairs\n";
+}